@@ -0,0 +1,184 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#include <string.h>
+#include <stdlib.h>
+
+#include <globus_common.h>
+
+#include "settings.h"
+#include "autopar.h"
+#include "output.h"
+#include "misc.h"
+
+#ifdef DMALLOC
+#include "dmalloc.h"
+#endif /* DMALLOC */
+
+/* Transfers at the settled count between probes. */
+#define AP_REPROBE 8
+
+/* A probe must beat the current rate by this factor to be kept. */
+#define AP_GAIN    1.10
+
+typedef struct _ap_ {
+	struct _ap_ * next;
+	char        * host;
+	int           cur;   /* Streams for the next transfer. */
+	int           best;  /* Streams that gave rate. */
+	int           dir;   /* Direction of the next probe, 1 up or -1 down. */
+	int           since; /* Transfers at best since the last probe. */
+	double        rate;  /* Smoothed goodput at best, bytes/sec. */
+} ap_t;
+
+static ap_t * aplist = NULL;
+
+static ap_t *
+_ap_find(char * host)
+{
+	ap_t * ap = NULL;
+
+	for (ap = aplist; ap; ap = ap->next)
+	{
+		if (strcmp(ap->host, host) == 0)
+			return ap;
+	}
+
+	ap = (ap_t *) malloc(sizeof(ap_t));
+	memset(ap, 0, sizeof(ap_t));
+	ap->host = Strdup(host);
+	ap->cur  = s_parallel();
+	ap->best = ap->cur;
+	ap->dir  = 1;
+	ap->next = aplist;
+	aplist   = ap;
+	return ap;
+}
+
+static int
+_ap_clamp(int cnt)
+{
+	if (cnt > s_autoparallel())
+		cnt = s_autoparallel();
+	if (cnt < 1)
+		cnt = 1;
+	return cnt;
+}
+
+/* Next count to try from cnt in direction dir. */
+static int
+_ap_step(int cnt, int dir)
+{
+	if (dir > 0)
+		return _ap_clamp(cnt * 2);
+	return _ap_clamp(cnt / 2);
+}
+
+int
+ap_parallel(char * host)
+{
+	if (!s_autoparallel() || !host)
+		return s_parallel();
+
+	return _ap_clamp(_ap_find(host)->cur);
+}
+
+void
+ap_update(char * host, int streams, globus_off_t bytes, long long usec)
+{
+	ap_t * ap   = NULL;
+	double rate = 0;
+
+	if (!s_autoparallel() || !host || usec <= 0)
+		return;
+
+	/*
+	 * Small files are dominated by setup and say nothing about the path.
+	 * Require a few blocks per stream before believing the rate.
+	 */
+	if (bytes < (globus_off_t)s_blocksize() * streams * 4)
+		return;
+
+	ap   = _ap_find(host);
+	rate = (double)bytes * 1000000 / usec;
+
+	if (ap->rate == 0 || streams == ap->best)
+	{
+		/* First sample or another transfer at the settled count. */
+		ap->best = streams;
+		ap->rate = ap->rate == 0 ? rate : (ap->rate * 3 + rate) / 4;
+
+		if (ap->since++ == 0 || ap->since >= AP_REPROBE)
+		{
+			ap->since = 1;
+			ap->cur   = _ap_step(streams, ap->dir);
+			/* At a limit, look the other way. */
+			if (ap->cur == streams)
+			{
+				ap->dir = -ap->dir;
+				ap->cur = _ap_step(streams, ap->dir);
+			}
+		}
+	} else if (rate > ap->rate * AP_GAIN)
+	{
+		/* The probe won. Keep going the same way. */
+		ap->dir   = streams > ap->best ? 1 : -1;
+		ap->best  = streams;
+		ap->rate  = rate;
+		ap->since = 1;
+		ap->cur   = _ap_step(streams, ap->dir);
+		if (ap->cur == streams)
+			ap->cur = ap->best;
+	} else
+	{
+		/* The probe lost. Settle and try the other way next time. */
+		ap->dir   = streams > ap->best ? -1 : 1;
+		ap->since = 1;
+		ap->cur   = ap->best;
+	}
+
+	o_printf(DEBUG_VERBOSE,
+	         "%s: %d streams at %.1f MB/s (%.1f MB/s per stream), next %d\n",
+	         host,
+	         streams,
+	         rate / (1024 * 1024),
+	         rate / streams / (1024 * 1024),
+	         _ap_clamp(ap->cur));
+}
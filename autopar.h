@@ -0,0 +1,61 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef UBER_AUTOPAR_H
+#define UBER_AUTOPAR_H
+
+#include <globus_common.h>
+
+/*
+ * Adaptive parallelism. When autoparallel is set, the number of extended
+ * block streams used for a host is tuned from the goodput of the transfers
+ * made to it. Each host starts at s_parallel() and doubles while the
+ * aggregate rate keeps improving, backs off once it stops, and is probed
+ * again every few transfers since paths change underneath us. The count
+ * never exceeds s_autoparallel(). State lasts for the life of the process.
+ */
+
+/* Streams to use for the next transfer with host. */
+int ap_parallel(char * host);
+
+/* Report a finished transfer of bytes over streams in usec microseconds. */
+void ap_update(char * host, int streams, globus_off_t bytes, long long usec);
+
+#endif /* UBER_AUTOPAR_H */
@@ -60,12 +60,20 @@
 #include "filetree.h"
 #include "settings.h"
 #include "logical.h"
+#include "pipeline.h"
+#include "reorder.h"
+#include "rangeset.h"
+#include "metrics.h"
+#include "journal.h"
 #include "output.h"
+#include "pool.h"
 #include "cmds.h"
 #include "misc.h"
 #include "unix.h"
 #include "ml.h"
 #include "nc.h"
+#include "worker.h"
+#include "uring.h"
 
 #ifdef SYSLOG_PERF
 #include "perf.h"
@@ -146,6 +154,8 @@ static cmd_t   * _c_lookup(char * cmd);
 
 static cmdret_t  _c_active();
 static cmdret_t  _c_ascii();
+static cmdret_t  _c_autoparallel(int max);
+static cmdret_t  _c_autotcpbuf(long long rate);
 static cmdret_t  _c_binary();
 static cmdret_t  _c_blksize(long long size);
 static cmdret_t  _c_bugs();
@@ -156,18 +166,25 @@ static cmdret_t  _c_chgrp(ch_t *, int rflag, char * group, char ** files);
 static cmdret_t  _c_chmod(ch_t *, int rflag, int perms, char ** files);
 static cmdret_t  _c_close(ch_t *);
 static cmdret_t  _c_cksum(char * val);
+static cmdret_t  _c_concurrency(int cnt);
+static cmdret_t  _c_congestion(char * alg);
 static cmdret_t  _c_cos(char * cos);
 static cmdret_t  _c_dcau(char mode, char * subject);
 static cmdret_t  _c_debug(int lvl);
+static cmdret_t  _c_directio(char * val);
 static cmdret_t  _c_glob(char * val);
 static cmdret_t  _c_family(char * family);
 static cmdret_t  _c_get(ch_t *, ch_t *, int, char *, char *);
 static cmdret_t  _c_hash();
 static cmdret_t  _c_help(char * cmd);
+static cmdret_t  _c_hostlimit(int cnt);
+static cmdret_t  _c_ioengine(char * engine);
+static cmdret_t  _c_journal(int dflag, char * path);
 static cmdret_t  _c_keepalive(int seconds);
 static cmdret_t  _c_list(ch_t *, int rflag, char * path, char * ofile);
 static cmdret_t  _c_lscos(ch_t *);
 static cmdret_t  _c_lsfam(ch_t *);
+static cmdret_t  _c_metrics(int dflag, char * path);
 static cmdret_t  _c_mkdir(ch_t *, char ** dirs);
 static cmdret_t  _c_mode(char mode);
 static cmdret_t  _c_mget(ch_t *, ch_t *, int rflag, char ** files);
@@ -182,11 +199,16 @@ static cmdret_t  _c_passive();
 static cmdret_t  _c_pbsz(long long length);
 static cmdret_t  _c_prot(char);
 static cmdret_t  _c_pget(ch_t*, ch_t*,globus_off_t, globus_off_t, char*, char*);
+static cmdret_t  _c_pipeline(int depth);
 static cmdret_t  _c_pwd(ch_t *);
 static cmdret_t  _c_quit(ch_t *, ch_t *);
 static cmdret_t  _c_quote(ch_t *, char ** words);
+static cmdret_t  _c_rateburst(long long size);
+static cmdret_t  _c_ratelimit(long long rate);
 static cmdret_t  _c_rename(ch_t *, char * sfile, char * dfile);
+static cmdret_t  _c_reorder(long long size);
 static cmdret_t  _c_retry(int cnt);
+static cmdret_t  _c_restartdir(int dflag, char * dir);
 static cmdret_t  _c_resume(int dflag, char * resume);
 static cmdret_t  _c_rm(ch_t *, int rflag, char ** files);
 static cmdret_t  _c_rmdir(ch_t *, char ** dirs);
@@ -194,6 +216,7 @@ static cmdret_t  _c_runique();
 static cmdret_t  _c_shell(char ** args);
 static cmdret_t  _c_size(ch_t *, char ** files);
 static cmdret_t  _c_stage(ch_t *, int rflag, int t, char ** files);
+static cmdret_t  _c_stripeblock(long long size);
 static cmdret_t  _c_sunique();
 static cmdret_t  _c_tcpbuf(long long size);
 #ifdef MSSFTP
@@ -201,6 +224,7 @@ static cmdret_t  _c_type(char *);
 #endif /* MSSFTP */
 static cmdret_t  _c_versions();
 static cmdret_t  _c_wait();
+static cmdret_t  _c_zerocopy(long long size);
 static cmdret_t  _c_link(ch_t *, char * oldfile, char * newfile);
 static cmdret_t  _c_symlink(ch_t *, char * oldfile, char * newfile);
 
@@ -255,6 +279,28 @@ static cmd_t gcmdlist [] = {
 "also known as IMAGE mode.\n",
 "ascii\n", NULL},
 
+	{ _c_autoparallel, "autoparallel", C_A_OINT,
+"Tune the number of parallel data connections for each host from the\n"
+"throughput of earlier extended block transfers to it. Each host starts\n"
+"at the parallel setting; the count is doubled while the transfer rate\n"
+"keeps improving, backed off when it does not, and probed again every few\n"
+"files. It never exceeds <max>. Files smaller than four blocks per\n"
+"connection are not measured. A <max> of 0 disables tuning, which is the\n"
+"default. If no number is given, the current setting is printed.\n",
+"autoparallel [max]\n",
+"max  Upper limit on parallel data connections, 0 to disable.\n"},
+
+	{ _c_autotcpbuf, "autotcpbuf", C_A_OLONG,
+"Size the TCP buffers of each host's data connections from the round trip\n"
+"time of its control connection, so that a single connection can carry\n"
+"<rate> bytes per second. Short paths get small buffers and long paths get\n"
+"large ones without setting tcpbuf for each site. The round trip time comes\n"
+"from the kernel when it reports one, otherwise from timing a NOOP. A\n"
+"<rate> of 0 disables this and tcpbuf is used, which is the default. If no\n"
+"rate is given, the current setting is printed.\n",
+"autotcpbuf [rate]\n",
+"rate  Bytes per second per data connection, 0 to disable.\n"},
+
 	{ _c_binary,  "binary", C_A_NOARGS,
 "Change the data transfer type to BINARY (aka IMAGE) which causes the server\n"
 "to not perform transformations to the file being transferred. This is the\n"
@@ -308,6 +354,21 @@ static cmd_t gcmdlist [] = {
 "on    Enable checksum comparison\n"
 "off   Disable checksum comparison\n"},
 
+	{ _c_concurrency, "concurrency", C_A_OINT,
+"Set the number of files that recursive and multiple file transfers keep in\n"
+"flight. Each file is moved by a separate process with its own control\n"
+"connection to the remote service. The retry, resume, cksum and timestamp\n"
+"settings apply to each file as usual. The default is one. If no number is\n"
+"given, the current setting is printed.\n",
+"concurrency [number]\n",
+"number  Number of concurrent file transfers.\n"},
+
+	{ _c_congestion, "congestion", C_A_OSTRING,
+"Use the TCP congestion control algorithm [name] for new connections if\n"
+"the kernel allows it. 'default' restores the system default. If [name] is\n"
+"omitted, the current setting is printed.\n",
+"congestion [name]\n", NULL},
+
 	{ _c_cos, "cos", C_A_OSTRING,
 "Sets the class of service to [name] on the FTP service if the service\n"
 "supports it. If [name] is omitted, the current class of service is printed.\n",
@@ -350,6 +411,15 @@ static cmd_t gcmdlist [] = {
 "target  Directory or file to list. '.' is used by default.\n"
 "file    Write listing to [file].\n"},
 
+	{ _c_directio, "directio", C_A_OSTRING,
+"Read and write local files with O_DIRECT, bypassing the page cache. Blocks\n"
+"that are not aligned to the page size (the end of a file or odd extended\n"
+"block offsets) still go through the page cache. blksize must be a multiple\n"
+"of 4096. This has no effect with ioengine uring.\n",
+"directio [on|off]\n",
+"on    Enable direct I/O\n"
+"off   Disable direct I/O (default)\n"},
+
 #ifdef MSSFTP
 	{ _c_close,    "disconnect",  C_A_RCH_1|C_A_NOARGS,
 "Alias for close. This command has been deprecated.\n",
@@ -386,6 +456,32 @@ static cmd_t gcmdlist [] = {
 "Otherwise, list all commands.\n",
 "help [command]\n", NULL},
 
+	{ _c_hostlimit, "hostlimit", C_A_OINT,
+"Set the number of url file transfers that may be in flight to any one host\n"
+"when concurrency is greater than one. 0 removes the limit, which is the\n"
+"default. If no number is given, the current setting is printed.\n",
+"hostlimit [number]\n",
+"number  Transfers per host, 0 for no limit.\n"},
+
+	{ _c_ioengine, "ioengine", C_A_OSTRING,
+"Select how local files are read and written. 'sync' issues one blocking\n"
+"read() or write() at a time. 'uring' keeps several requests queued through\n"
+"io_uring so that fast local storage can keep up with parallel data\n"
+"channels. If the kernel does not support io_uring, 'sync' is used. If no\n"
+"engine is given, the current engine is printed.\n",
+"ioengine [sync|uring]\n",
+"sync   One blocking request at a time (default).\n"
+"uring  Queue requests through io_uring.\n"},
+
+	{ _c_journal,	"journal", C_A_OPT_d|C_A_OSTRING,
+"Record each file that recursive and multiple file transfers (and url file\n"
+"entries) complete in the given journal, along with its size and, if cksum\n"
+"is on, its checksum. Files already in the journal are skipped, so a job\n"
+"that died can be restarted with the same journal.\n",
+"journal [-d] [file]\n",
+"file   Journal to use. If file is not given, print the current journal.\n"
+"-d     Stop using a journal.\n"},
+
 	{ _c_keepalive, "keepalive", C_A_OINT,
 "Attempts to keep the control channel from being blocked by firewalls during\n"
 "long data channel operations. UberFTP sends a NOOP command to the service\n"
@@ -553,6 +649,17 @@ static cmd_t gcmdlist [] = {
 "-r   Recursively remove the given directory.\n"},
 #endif /* MSSFTP */
 
+	{ _c_metrics,	"metrics", C_A_OPT_d|C_A_OSTRING,
+"Record per transfer metrics as JSON, one line per file, appended to\n"
+"the given file. Each line holds the bytes moved, elapsed time, rate and\n"
+"retries along with the time spent waiting on the source and the\n"
+"destination, driving extended block channels and in GSS wrap/unwrap,\n"
+"plus the bytes and blocks carried by each extended block channel.\n",
+"metrics [-d] [file]\n",
+"file   File to append metrics to. If file is not given, print the current\n"
+"       metrics file.\n"
+"-d     Stop recording metrics.\n"},
+
 	{ _c_mget,       "mget", C_A_RCH_1|C_A_LCH_2|C_A_OPT_r|C_A_STRINGS,
 "Retrieve file(s) from the remote service. This is similiar to making\n"
 "multiple calls to get without specifying a destination.\n",
@@ -644,6 +751,15 @@ static cmd_t gcmdlist [] = {
 "destfile Name of local file. srcfile is used if destfile\n"
 "         is not specified\n"},
 
+	{ _c_pipeline, "pipeline", C_A_OINT,
+"Set the number of blocks that may be read from the source ahead of the\n"
+"destination during a transfer. The source is read in a separate thread\n"
+"so that disk and network I/O can overlap. A value of zero disables read\n"
+"ahead. Third party transfers are never pipelined. The default is two. If\n"
+"no number is given, the current setting is printed.\n",
+"pipeline [number]\n",
+"number  Number of blocks to read ahead.\n"},
+
 	{ _c_pget,  "pput",  C_A_LCH_1|C_A_RCH_2|C_A_2OFF,
 "Store only the specified portion of the file(s). If srcfile is a regular\n"
 "expression and expands to multiple files, and destination is given,\n"
@@ -697,10 +813,45 @@ static cmd_t gcmdlist [] = {
 "-r   Recursively transfer the given directory.\n"},
 #endif /* MSSFTP */
 
+	{ _c_rateburst, "rateburst", C_A_OLONG,
+"Set how many bytes the data channels may move at once, beyond ratelimit,\n"
+"after being idle. A [size] of 0 picks a tenth of a second at the limited\n"
+"rate, which is the default. If no size is given, the current setting is\n"
+"printed.\n",
+"rateburst [size]\n", NULL},
+
+	{ _c_ratelimit, "ratelimit", C_A_OLONG,
+"Cap all data channel traffic at [rate] bytes per second. The limit covers\n"
+"every parallel stream and every concurrent file transfer together, so\n"
+"streams that are not held back share what the others leave. Reads and\n"
+"writes both count. A [rate] of 0 removes the limit, which is the default.\n"
+"If no rate is given, the current setting is printed.\n",
+"ratelimit [rate]\n", NULL},
+
 	{ _c_rename, "rename", C_A_RCH_1|C_A_2STRINGS,
 "Rename the remote object <src> to <dst>.\n",
 "rename <src> <dst>\n", NULL},
 
+	{ _c_reorder, "reorder", C_A_OLONG,
+"Set the most memory, in bytes, used to put extended block data back in\n"
+"order for destinations that can not seek, such as '|command' pipes and\n"
+"cat. Blocks that arrive ahead of a missing one are held until it shows up.\n"
+"A transfer that needs more than <size> bytes held fails. The default is\n"
+"64MB. If no size is given, the current setting is printed.\n",
+"reorder [size]\n", NULL},
+
+	{ _c_restartdir, "restartdir", C_A_OPT_d|C_A_OSTRING,
+"Keep a map of the byte ranges each file transfer has completed in <dir>.\n"
+"Retries already resend only the missing ranges; with a restartdir, running\n"
+"the same transfer again after the client was killed does too. A failed\n"
+"file is left in place when its map is saved. Maps are removed once the\n"
+"file is complete. Partial restarts need ERET/ESTO support from the\n"
+"remote service.\n",
+"restartdir [-d] [dir]\n",
+"dir    Directory for the range maps. If dir is not given, print the\n"
+"       current setting.\n"
+"-d     Stop saving range maps.\n"},
+
 	{ _c_resume,	"resume", C_A_OPT_d|C_A_OSTRING,
 "Sets a restart point for recursive transfers. If a long recursive transfer\n"
 "fails, you can set resume to the path that failed and UberFTP will skip\n"
@@ -749,6 +900,17 @@ static cmd_t gcmdlist [] = {
 "seconds  number of seconds to attempt staging\n"
 "-r       Recursively stage all files in the given subdirectory.\n"},
 
+	{ _c_stripeblock, "stripeblock", C_A_OLONG,
+"Set the block size, in bytes, of a striped server's blocked layout. During\n"
+"extended block stores to several stripes, each block is sent on a\n"
+"connection to the stripe that holds its offset ((offset / size) modulo\n"
+"the number of stripes) so the server's nodes do not forward data to each\n"
+"other. Retrieves ask the server for the same layout. Use a multiple of\n"
+"blksize so blocks do not straddle stripes. Zero, the default, sends\n"
+"blocks on any connection. If no size is given, the current setting is\n"
+"printed.\n",
+"stripeblock [size]\n", NULL},
+
 	{ _c_sunique,  "sunique", C_A_NOARGS,
 "Toggles the client to store files using unique names during put operations.\n",
 "sunique\n", NULL},
@@ -785,6 +947,15 @@ static cmd_t gcmdlist [] = {
 "to retrieve them.\n",
 "wait\n", NULL},
 
+	{ _c_zerocopy, "zerocopy", C_A_OLONG,
+"Send data channel blocks of at least [size] bytes straight from memory with\n"
+"MSG_ZEROCOPY instead of copying them into the socket. This saves CPU on\n"
+"fast links but only applies when the data channel is not protected (prot\n"
+"clear) and the kernel supports it; blocks are reused only once the kernel\n"
+"is done sending them. A [size] of 0 disables zero copy, which is the\n"
+"default. If no size is given, the current setting is printed.\n",
+"zerocopy [size]\n", NULL},
+
 	{ NULL, NULL}
 };
 
@@ -795,6 +966,11 @@ cmd_init()
 	grch.lh = l_init(NcInterface); /* Remote connection handle. */
 }
 
+int
+cmd_lost(int local)
+{
+	return l_lost(local ? glch.lh : grch.lh);
+}
 
 cmdret_t
 cmd_intrptr(char * cmd)
@@ -1363,6 +1539,38 @@ _c_ascii()
 	return CMD_SUCCESS;
 }
 
+static cmdret_t
+_c_autoparallel(int max)
+{
+	if (max != -1)
+		s_setautoparallel(max);
+
+	if (s_autoparallel())
+		o_printf(DEBUG_NORMAL,
+		         "Tuning parallel data channels up to %d per host\n",
+		         s_autoparallel());
+	else
+		o_printf(DEBUG_NORMAL, "Parallel data channel tuning is disabled\n");
+
+	return CMD_SUCCESS;
+}
+
+static cmdret_t
+_c_autotcpbuf(long long rate)
+{
+	if (rate != -1)
+		s_setautotcpbuf(rate);
+
+	if (s_autotcpbuf())
+		o_printf(DEBUG_NORMAL,
+		         "Sizing TCP buffers for %lld bytes per second\n",
+		         s_autotcpbuf());
+	else
+		o_printf(DEBUG_NORMAL, "TCP buffer sizing is disabled\n");
+
+	return CMD_SUCCESS;
+}
+
 static cmdret_t
 _c_binary()
 {
@@ -1402,6 +1610,7 @@ _c_cat(ch_t * ch, char ** files)
 	cmdret_t  cr     = CMD_SUCCESS;
 	size_t    len    = 0;
 	char    * buf    = NULL;
+	ro_t    * ro     = NULL;
 	globus_off_t  off = 0;
 
 	for (; cr == CMD_SUCCESS && *files; files++, nl=0)
@@ -1454,16 +1663,31 @@ retry:
 
 			nl  = 0;
 			eof = 0;
+			/* Extended block data may arrive out of order. */
+			ro  = ro_init(0);
 			while (ec == EC_SUCCESS && !eof)
 			{
 				ec = l_read(ch->lh, NULL, &buf, &off, &len, &eof);
 				if (ec == EC_SUCCESS && buf != NULL)
+					ec = ro_put(ro, buf, off, len);
+				buf = NULL;
+
+				while (ec == EC_SUCCESS)
 				{
+					ro_get(ro, &buf, &off, &len);
+					if (!buf)
+						break;
 					o_fwrite(stdout, DEBUG_ERRS_ONLY, buf, len);
 					nl = 1;
+					pool_free(buf);
 				}
-				FREE(buf);
+				buf = NULL;
+
+				if (ec == EC_SUCCESS && eof)
+					ec = ro_finish(ro);
 			}
+			ro_destroy(ro);
+			ro = NULL;
 
 			if (nl)
 				o_printf(DEBUG_ERRS_ONLY, "\n");
@@ -1694,6 +1918,33 @@ _c_cksum(char * val)
 	return CMD_SUCCESS;
 }
 
+static cmdret_t
+_c_concurrency(int cnt)
+{
+	if (cnt != -1)
+		s_setconcurrency(cnt);
+
+	o_printf(DEBUG_NORMAL,
+	         "Transferring up to %d file%s at a time\n",
+	         s_concurrency(),
+	         s_concurrency() == 1 ? "" : "s");
+
+	return CMD_SUCCESS;
+}
+
+static cmdret_t
+_c_congestion(char * alg)
+{
+	if (alg)
+		s_setcongestion(alg);
+
+	if (s_congestion())
+		o_printf(DEBUG_NORMAL, "TCP congestion control set to %s\n", s_congestion());
+	else
+		o_printf(DEBUG_NORMAL, "TCP congestion control set to the default.\n");
+	return CMD_SUCCESS;
+}
+
 static cmdret_t
 _c_cos(char * cos)
 {
@@ -1782,6 +2033,28 @@ _c_debug(int lvl)
 	return CMD_SUCCESS;
 }
 
+static cmdret_t
+_c_directio(char * val)
+{
+	if (val)
+	{
+		if (strcmp(val, "on") == 0)
+			s_setdirectio(1);
+		else if (strcmp(val, "off") == 0)
+			s_setdirectio(0);
+		else
+		{
+			o_fprintf(stderr, DEBUG_ERRS_ONLY, "Illegal value %s\n", val);
+			return CMD_ERR_BAD_CMD;
+		}
+	}
+
+	o_printf(DEBUG_NORMAL, 
+	         "directio is %s.\n", 
+	         s_directio() ? "enabled" : "disabled");
+	return CMD_SUCCESS;
+}
+
 static cmdret_t
 _c_family(char * family)
 {
@@ -1908,6 +2181,68 @@ _c_help(char * cmd)
 	return CMD_SUCCESS;
 }
 
+static cmdret_t
+_c_hostlimit(int cnt)
+{
+	if (cnt != -1)
+		s_sethostlimit(cnt);
+
+	if (s_hostlimit())
+		o_printf(DEBUG_NORMAL,
+		         "Transferring up to %d file%s at a time per host\n",
+		         s_hostlimit(),
+		         s_hostlimit() == 1 ? "" : "s");
+	else
+		o_printf(DEBUG_NORMAL, "Transfers per host are not limited\n");
+
+	return CMD_SUCCESS;
+}
+
+static cmdret_t
+_c_ioengine(char * engine)
+{
+	if (engine)
+	{
+		if (strcasecmp(engine, "sync") == 0)
+			s_setioengine(IOENGINE_SYNC);
+		else if (strcasecmp(engine, "uring") == 0)
+		{
+			if (!ur_supported())
+			{
+				o_fprintf(stderr, 
+				          DEBUG_ERRS_ONLY, 
+				          "io_uring support was not compiled in.\n");
+				return CMD_ERR_BAD_CMD;
+			}
+			s_setioengine(IOENGINE_URING);
+		}
+		else
+		{
+			o_fprintf(stderr, DEBUG_ERRS_ONLY, "Illegal value %s\n", engine);
+			return CMD_ERR_BAD_CMD;
+		}
+	}
+
+	o_printf(DEBUG_NORMAL, 
+	         "Local I/O engine is %s.\n", 
+	         s_ioengine() == IOENGINE_URING ? "uring" : "sync");
+	return CMD_SUCCESS;
+}
+
+static cmdret_t
+_c_journal(int dflag, char * path)
+{
+	if (dflag)
+		s_setjournal(NULL);
+	if (path)
+		s_setjournal(path);
+	if (!s_journal())
+		o_printf(DEBUG_NORMAL, "No journal is in use.\n");
+	else
+		o_printf(DEBUG_NORMAL, "%s\n", s_journal());
+	return CMD_SUCCESS;
+}
+
 static cmdret_t
 _c_keepalive(int seconds)
 {
@@ -2020,6 +2355,20 @@ _c_lsfam(ch_t * ch)
 	return cr;
 }
 
+static cmdret_t
+_c_metrics(int dflag, char * path)
+{
+	if (dflag)
+		s_setmetrics(NULL);
+	if (path)
+		s_setmetrics(path);
+	if (!s_metrics())
+		o_printf(DEBUG_NORMAL, "Metrics are not being recorded.\n");
+	else
+		o_printf(DEBUG_NORMAL, "%s\n", s_metrics());
+	return CMD_SUCCESS;
+}
+
 static cmdret_t
 _c_mkdir(ch_t * ch, char ** dirs)
 {
@@ -2344,6 +2693,22 @@ _c_pbsz(long long length)
 	return CMD_SUCCESS;
 }
 
+static cmdret_t
+_c_pipeline(int depth)
+{
+	if (depth != -1)
+		s_setpipeline(depth);
+
+	if (!s_pipeline())
+		o_printf(DEBUG_NORMAL, "Transfer pipelining disabled\n");
+	else
+		o_printf(DEBUG_NORMAL, 
+		         "Reading up to %d blocks ahead during transfers\n",
+		         s_pipeline());
+
+	return CMD_SUCCESS;
+}
+
 static cmdret_t
 _c_prot(char mode)
 {
@@ -2465,6 +2830,34 @@ _c_quote(ch_t * ch, char ** words)
 	return cr;
 }
 
+static cmdret_t
+_c_rateburst(long long size)
+{
+	if (size != -1)
+		s_setrateburst(size);
+
+	if (s_rateburst())
+		o_printf(DEBUG_NORMAL, "Rate burst set to %lld bytes\n", s_rateburst());
+	else
+		o_printf(DEBUG_NORMAL, "Rate burst set to the default\n");
+	return CMD_SUCCESS;
+}
+
+static cmdret_t
+_c_ratelimit(long long rate)
+{
+	if (rate != -1)
+		s_setratelimit(rate);
+
+	if (s_ratelimit())
+		o_printf(DEBUG_NORMAL,
+		         "Data channels limited to %lld bytes per second\n",
+		         s_ratelimit());
+	else
+		o_printf(DEBUG_NORMAL, "Data channel rate limit is disabled\n");
+	return CMD_SUCCESS;
+}
+
 static cmdret_t
 _c_rename(ch_t * ch, char * sfile, char * dfile)
 {
@@ -2563,6 +2956,15 @@ finish:
 	return cr;
 }
 
+static cmdret_t
+_c_reorder(long long size)
+{
+	if (size != -1)
+		s_setreorder(size);
+	o_printf(DEBUG_NORMAL, "Reorder limit set to %lld bytes\n", s_reorder());
+	return CMD_SUCCESS;
+}
+
 static cmdret_t
 _c_retry(int cnt)
 {
@@ -2578,6 +2980,20 @@ _c_retry(int cnt)
 	return CMD_SUCCESS;
 }
 
+static cmdret_t
+_c_restartdir(int dflag, char * dir)
+{
+	if (dflag)
+		s_setrestartdir(NULL);
+	if (dir)
+		s_setrestartdir(dir);
+	if (!s_restartdir())
+		o_printf(DEBUG_NORMAL, "Restartdir is not set.\n");
+	else
+		o_printf(DEBUG_NORMAL, "%s\n", s_restartdir());
+	return CMD_SUCCESS;
+}
+
 static cmdret_t
 _c_resume(int dflag, char * path)
 {
@@ -2922,6 +3338,21 @@ _c_stage(ch_t * ch, int rflag, int t, char ** files)
 	return cr;
 }
 
+static cmdret_t
+_c_stripeblock(long long size)
+{
+	if (size != -1)
+		s_setstripeblock(size);
+
+	if (s_stripeblock())
+		o_printf(DEBUG_NORMAL,
+		         "Stripe block size set to %lld\n",
+		         s_stripeblock());
+	else
+		o_printf(DEBUG_NORMAL, "Stripe layout is not set\n");
+	return CMD_SUCCESS;
+}
+
 static cmdret_t
 _c_sunique()
 {
@@ -3002,6 +3433,22 @@ _c_wait()
 	return CMD_SUCCESS;
 }
 
+static cmdret_t
+_c_zerocopy(long long size)
+{
+	if (size != -1)
+		s_setzerocopy(size);
+
+	if (s_zerocopy())
+		o_printf(DEBUG_NORMAL,
+		         "Zero copy sends for blocks of %lld bytes or more\n",
+		         s_zerocopy());
+	else
+		o_printf(DEBUG_NORMAL, "Zero copy sends are disabled\n");
+
+	return CMD_SUCCESS;
+}
+
 static errcode_t
 _c_get_ml(ch_t * ch, char * target, int type, ml_t ** mlp)
 {
@@ -3090,6 +3537,270 @@ _c_utime(ch_t * Channel,
 	return cr;
 }
 
+/*
+ * Concurrent file transfers. When s_concurrency() > 1, _c_xfer() walks the
+ * source tree as usual, creating directories itself, but hands each
+ * regular file to a pool of forked workers. Each worker drops its inherited
+ * copy of the control connections and reconnects on first use, so every
+ * worker has a private session with the same settings and working
+ * directory as ours.
+ */
+typedef struct {
+	int    hasmod;
+	time_t modify;
+	/* Followed by "src\0dst\0". */
+} xj_t;
+
+typedef struct {
+	char       * name;
+	globus_off_t size;
+} xf_t;
+
+typedef struct {
+	ch_t       * sch;
+	ch_t       * dch;
+	int          unique;
+	globus_off_t soff;
+	globus_off_t slen;
+	char       * spwd; /* Working directories for journal keys. */
+	char       * dpwd;
+
+	/* Only meaningful in the parent. */
+	cmdret_t     cr;
+	xf_t       * files;
+	int          nfiles;
+	int          done;
+	globus_off_t bytes;
+} xs_t;
+
+/*
+ * Journal key for path on ch: a URL naming the server and the absolute
+ * path, so a journal reused against another server or working directory
+ * does not match.
+ */
+static char *
+_c_jn_key(ch_t * ch, char * pwd, char * path)
+{
+	char * abs = NULL;
+	char * key = NULL;
+
+	if (*path == '/' || !pwd)
+		abs = Strdup(path);
+	else
+		abs = Sprintf(NULL, 
+		              "%s%s%s", 
+		              pwd, 
+		              pwd[strlen(pwd) - 1] == '/' ? "" : "/", 
+		              path);
+
+	key = l_url(ch->lh, abs);
+	if (!key)
+		return abs;
+
+	FREE(abs);
+	return key;
+}
+
+static int
+_c_jn_done(xs_t * xs, char * src, char * dst)
+{
+	char * skey = NULL;
+	char * dkey = NULL;
+	int    done = 0;
+
+	if (!s_journal())
+		return 0;
+
+	skey = _c_jn_key(xs->sch, xs->spwd, src);
+	dkey = _c_jn_key(xs->dch, xs->dpwd, dst);
+	done = jn_done(skey, dkey);
+	FREE(skey);
+	FREE(dkey);
+	return done;
+}
+
+static void
+_c_jn_add(xs_t * xs, char * src, char * dst)
+{
+	char * skey = NULL;
+	char * dkey = NULL;
+
+	if (!s_journal())
+		return;
+
+	skey = _c_jn_key(xs->sch, xs->spwd, src);
+	dkey = _c_jn_key(xs->dch, xs->dpwd, dst);
+	jn_add(skey, dkey);
+	FREE(skey);
+	FREE(dkey);
+}
+
+static void
+_c_xfer_start(void * arg)
+{
+	xs_t * xs = (xs_t *) arg;
+
+	l_detach(xs->sch->lh);
+	l_detach(xs->dch->lh);
+}
+
+static int
+_c_xfer_run(void * arg, char * job, size_t len)
+{
+	xs_t   * xs  = (xs_t *) arg;
+	xj_t   * xj  = (xj_t *) job;
+	char   * src = job + sizeof(xj_t);
+	char   * dst = src + strlen(src) + 1;
+	cmdret_t cr  = CMD_SUCCESS;
+	ml_t     ref;
+
+	cr = _c_xfer_file(xs->sch, 
+	                  xs->dch, 
+	                  src, 
+	                  dst, 
+	                  xs->unique, 
+	                  xs->soff, 
+	                  xs->slen);
+
+	/* If the transfer was successful, update the timestamp. */
+	if (cr == CMD_SUCCESS)
+	{
+		memset(&ref, 0, sizeof(ml_t));
+		ref.mf.Modify = xj->hasmod;
+		ref.modify    = xj->modify;
+		_c_utime(xs->dch, dst, &ref);
+
+		_c_jn_add(xs, src, dst);
+	}
+
+	return cr;
+}
+
+static void
+_c_xfer_stop(void * arg)
+{
+	xs_t    * xs  = (xs_t *) arg;
+	errcode_t ec  = EC_SUCCESS;
+	char    * msg = NULL;
+
+	/* Say goodbye on the sessions we opened. */
+	if (l_is_ftp_service(xs->sch->lh))
+	{
+		ec = l_disconnect(xs->sch->lh, &msg);
+		ec_destroy(ec);
+		FREE(msg);
+	}
+
+	if (l_is_ftp_service(xs->dch->lh))
+	{
+		ec = l_disconnect(xs->dch->lh, &msg);
+		ec_destroy(ec);
+		FREE(msg);
+	}
+}
+
+static void
+_c_xfer_done(void * arg, int id, int result)
+{
+	xs_t * xs = (xs_t *) arg;
+
+	if (result == WP_LOST)
+	{
+		o_fprintf(stderr,
+		          DEBUG_ERRS_ONLY,
+		          "%s: Transfer process exited unexpectedly.\n",
+		          xs->files[id].name);
+		result = CMD_ERR_OTHER;
+	}
+
+	if (result == CMD_SUCCESS)
+	{
+		xs->done++;
+		xs->bytes += xs->files[id].size;
+	}
+
+	xs->cr |= result;
+}
+
+static wpi_t _c_xfer_wpi = {
+	_c_xfer_start,
+	_c_xfer_run,
+	_c_xfer_stop,
+	_c_xfer_done,
+};
+
+/*
+ * Queue src -> dst on the worker pool. Returns non zero if the pool could
+ * not take the file, in which case the caller should transfer it itself.
+ */
+static int
+_c_xfer_submit(wp_t * wp, xs_t * xs, ml_t * smlp, char * dst)
+{
+	errcode_t ec   = EC_SUCCESS;
+	xj_t    * xj   = NULL;
+	char    * job  = NULL;
+	size_t    len  = 0;
+	size_t    slen = strlen(smlp->name) + 1;
+	size_t    dlen = strlen(dst) + 1;
+
+	len = sizeof(xj_t) + slen + dlen;
+	job = (char *) malloc(len);
+	xj  = (xj_t *) job;
+	xj->hasmod = smlp->mf.Modify;
+	xj->modify = smlp->modify;
+	memcpy(job + sizeof(xj_t), smlp->name, slen);
+	memcpy(job + sizeof(xj_t) + slen, dst, dlen);
+
+	xs->files = (xf_t *) realloc(xs->files, sizeof(xf_t) * (xs->nfiles + 1));
+	xs->files[xs->nfiles].name = Strdup(smlp->name);
+	xs->files[xs->nfiles].size = xs->slen != (globus_off_t)-1 ? xs->slen 
+	                                                         : smlp->size;
+
+	ec = wp_submit(wp, xs->nfiles, job, len);
+	FREE(job);
+
+	if (ec)
+	{
+		ec_print(ec);
+		ec_destroy(ec);
+		FREE(xs->files[xs->nfiles].name);
+		return 1;
+	}
+
+	xs->nfiles++;
+	return 0;
+}
+
+static void
+_c_xfer_report(xs_t * xs, struct timeval * start)
+{
+	char         * buf  = NULL;
+	char         * tim  = NULL;
+	char         * rate = NULL;
+	struct timeval stop;
+
+	gettimeofday(&stop, NULL);
+
+	buf  = Sprintf(NULL, "%"GLOBUS_OFF_T_FORMAT" bytes", xs->bytes);
+	tim  = Convtime(start, &stop);
+	rate = MkRate(start, &stop, xs->bytes);
+
+	o_fprintf(stdout,
+	          DEBUG_NORMAL,
+	          "%d of %d files: %s in %s%s%s%s\n",
+	          xs->done,
+	          xs->nfiles,
+	          buf,
+	          tim,
+	          rate  ? " ("  : "",
+	          rate  ? rate : "",
+	          rate  ? ")"  : "");
+
+	FREE(buf);
+	FREE(tim);
+	FREE(rate);
+}
+
 static cmdret_t
 _c_xfer(ch_t       * sch, 
         ch_t       * dch, 
@@ -3117,7 +3828,19 @@ _c_xfer(ch_t       * sch,
 	ml_t    * tmlp   = NULL;
 	int       msrcs  = 0;
 	int       opts   = 0;
+	int       i      = 0;
+	int       serial = 0; /* Do not try the worker pool. */
+	wp_t    * wp     = NULL;
+	xs_t      xs;
 	char    * dirs[2];
+	struct timeval start;
+
+	memset(&xs, 0, sizeof(xs_t));
+	xs.sch    = sch;
+	xs.dch    = dch;
+	xs.unique = unique;
+	xs.soff   = soff;
+	xs.slen   = slen;
 
 	/* Determine the source object(s) and type(s). */
 	sfth = ft_init(sch->lh, sfile, opts);
@@ -3146,6 +3869,13 @@ _c_xfer(ch_t       * sch,
 			goto finish;
 	}
 
+	/* Journal keys name files by absolute path. */
+	if (s_journal() && (rflag || msrcs))
+	{
+		ec_destroy(l_pwd(sch->lh, &xs.spwd));
+		ec_destroy(l_pwd(dch->lh, &xs.dpwd));
+	}
+
 	if (smlp->type == 0)
 	{
 		if (rflag)
@@ -3304,12 +4034,45 @@ _c_xfer(ch_t       * sch,
 		{
 		case 0:
 		case S_IFREG:
+			/* Skip files that an earlier run finished. */
+			if ((rflag || msrcs) && _c_jn_done(&xs, smlp->name, target))
+			{
+				o_printf(DEBUG_VERBOSE,
+				         "%s: Found in the journal, skipping.\n",
+				         smlp->name);
+				break;
+			}
+
+			if (!wp && !serial && s_concurrency() > 1 && (rflag || msrcs))
+			{
+				gettimeofday(&start, NULL);
+				ec = wp_init(&wp, s_concurrency(), &_c_xfer_wpi, &xs);
+				if (ec)
+				{
+					ec_print(ec);
+					ec_destroy(ec);
+					ec = EC_SUCCESS;
+					serial = 1;
+				}
+			}
+
+			if (wp && !serial)
+			{
+				if (!_c_xfer_submit(wp, &xs, smlp, target))
+					break;
+				/* The pool is gone; carry on by ourselves. */
+				serial = 1;
+			}
+
 			lcr = _c_xfer_file(sch, dch, smlp->name, target, unique, soff, slen);
 
 			/* If the transfer was successful, update the timestamp. */
 			if (lcr == CMD_SUCCESS)
 				_c_utime(dch, target, smlp);
 
+			if (lcr == CMD_SUCCESS && (rflag || msrcs))
+				_c_jn_add(&xs, smlp->name, target);
+
 			/* Update cr with any local error. */
 			cr |= lcr;
 			break;
@@ -3327,6 +4090,19 @@ _c_xfer(ch_t       * sch,
 	} while (!(ec = ft_get_next_ft(sfth, &smlp, 0)) && smlp);
 
 finish:
+	if (wp)
+	{
+		/* Wait for the files still in flight. */
+		wp_destroy(wp);
+		_c_xfer_report(&xs, &start);
+		cr |= xs.cr;
+	}
+	for (i = 0; i < xs.nfiles; i++)
+		FREE(xs.files[i].name);
+	FREE(xs.files);
+	FREE(xs.spwd);
+	FREE(xs.dpwd);
+
 	if (ec)
 		cr = CMD_ERR_GET;
 	ec_print(ec);
@@ -3344,6 +4120,43 @@ finish:
 	return cr;
 }
 
+/* Seconds between saves of the range map during a transfer. */
+#define C_RANGE_CHECKPOINT 30
+
+/* Name of the range map for src -> dst in the restartdir. */
+static char *
+_c_range_map(char * src, char * dst)
+{
+	unsigned long long hash = FNV1A_BASIS;
+
+	/* Hash "src\ndst". */
+	hash = Fnv1a(hash, src, strlen(src));
+	hash = Fnv1a(hash, "\n", 1);
+	hash = Fnv1a(hash, dst, strlen(dst));
+
+	return Sprintf(NULL, "%s/%016llx.ranges", s_restartdir(), hash);
+}
+
+/* Save done plus lag, the ranges that are old enough to have been written. */
+static void
+_c_range_save(char * map, rs_t * done, rs_t * lag, char * src, char * dst, globus_off_t end)
+{
+	errcode_t ec = EC_SUCCESS;
+	rs_t    * rs = rs_init();
+
+	rs_merge(rs, done);
+	if (lag)
+		rs_merge(rs, lag);
+
+	ec = rs_save(rs, map, src, dst, end);
+	if (ec)
+	{
+		ec_print(ec);
+		ec_destroy(ec);
+	}
+	rs_destroy(rs);
+}
+
 static cmdret_t
 _c_xfer_file(ch_t * sch,
              ch_t * dch,
@@ -3363,15 +4176,33 @@ _c_xfer_file(ch_t * sch,
 	int             staged  = 0;
 	int             retry   = s_retry();
 	int             eof     = 0;
+	int             zcopy   = 0;
+	int             ranged  = 0;
+	int             wfail   = 0;
+	int             setup   = 0;
 	int             supported = 0;
 	ml_t          * dmlp    = NULL;
+	pl_t          * pl      = NULL;
+	rs_t          * done    = NULL;
+	rs_t          * cur     = NULL;
+	rs_t          * lag     = NULL;
+	char          * map     = NULL;
+	time_t          saved   = 0;
 	char          * buf     = NULL;
 	char          * tim     = NULL;
 	char          * rate    = NULL;
 	struct timeval  start;
 	struct timeval  stop;
+	struct timeval  xstart;
+	long long       xusec   = 0; /* Spent moving data, over every range. */
+	struct timeval  mxt;
 	size_t          len     = 0;
 	globus_off_t    off     = 0;
+	globus_off_t    zleft   = 0;
+	globus_off_t    base    = 0;
+	globus_off_t    xoff    = 0;
+	globus_off_t    xlen    = 0;
+	globus_off_t    have    = 0;
 	unsigned int    lcrc    = 0;
 	unsigned int    rcrc    = 0;
 
@@ -3424,22 +4255,86 @@ _c_xfer_file(ch_t * sch,
 		return CMD_ERR_GET;
 	}
 
+	/*
+	 * Remember which ranges reach the destination so that a retry only
+	 * moves what is missing. With a restartdir, the ranges are also kept on
+	 * disk so that a later run can pick up where this one died. Pipes,
+	 * unique names and ASCII transfers, whose offsets differ between the
+	 * two ends, can not be restarted.
+	 */
+	base   = soff == (globus_off_t)-1 ? 0 : soff;
+	ranged = !unique && !s_ascii() && *src != '|' && *dst != '|';
+	done   = rs_init();
+	cur    = rs_init();
+	lag    = rs_init();
+
+	if (ranged && s_restartdir())
+	{
+		map = _c_range_map(src, dst);
+		ec  = rs_load(done, map, src, dst, base + slen);
+		ec_print(ec);
+		ec_destroy(ec);
+		ec = EC_SUCCESS;
+
+		/* Only trust the map if the destination still holds that much. */
+		if (rs_bytes(done))
+		{
+			ec = l_size(dch->lh, dst, &have);
+			if (ec || have < rs_end(done))
+				rs_clear(done);
+			else
+				o_printf(DEBUG_NORMAL,
+				         "%s: Resuming, %" GLOBUS_OFF_T_FORMAT
+				         " of %" GLOBUS_OFF_T_FORMAT " bytes already sent.\n",
+				         src,
+				         rs_bytes(done),
+				         slen);
+			ec_destroy(ec);
+			ec = EC_SUCCESS;
+		}
+		saved = time(NULL);
+	}
+
+	gettimeofday(&start, NULL);
+	stop = start;
+
 	/* Transfer it */
+	mx_start(src, dst);
 	while (1)
 	{
-		if (retry < s_retry())
+		if (retry < s_retry() && (ec || ecl || ecr) && setup != 2)
+		{
 			o_fprintf(stderr,
 			          DEBUG_ERRS_ONLY,
 			          "%s: Transfer failed, retrying.\n",
 			          src);
+			mx_retry();
+		}
 
 		ec_destroy(ec);
 		ec_destroy(ecl);
 		ec_destroy(ecr);
 		ec = ecl = ecr = NULL;
-		eof = 0;
+		eof   = 0;
+		wfail = 0;
+		setup = 0;
+
+		/* Move the first missing range, or everything if none is known. */
+		xoff = soff;
+		xlen = slen;
+		if (rs_bytes(done))
+		{
+			if (!rs_gap(done, base, base + slen, &xoff, &xlen))
+				break;
+			o_printf(DEBUG_VERBOSE,
+			         "%s: Sending %" GLOBUS_OFF_T_FORMAT " bytes at offset %"
+			         GLOBUS_OFF_T_FORMAT ".\n",
+			         src,
+			         xlen,
+			         xoff);
+		}
 
-		ec = l_storfile(dch->lh, sch->lh, dst, unique, soff, slen);
+		ec = l_storfile(dch->lh, sch->lh, dst, unique, xoff, xlen);
 
 		if (ec != EC_SUCCESS)
 		{
@@ -3447,13 +4342,14 @@ _c_xfer_file(ch_t * sch,
 			          DEBUG_ERRS_ONLY,
 			          "%s: Failed to store file.\n",
 			          dst);
+			setup = 1;
 			goto cleanup;
 		}
 
-		if (soff == (globus_off_t)-1)
+		if (xoff == (globus_off_t)-1)
 			delfile = 1;
 
-		ec = l_retrvfile(sch->lh, dch->lh, src, soff, slen);
+		ec = l_retrvfile(sch->lh, dch->lh, src, xoff, xlen);
 
 		if (ec != EC_SUCCESS)
 		{
@@ -3461,13 +4357,29 @@ _c_xfer_file(ch_t * sch,
           			DEBUG_ERRS_ONLY,
           			"%s: Failed to retrieve file.\n",
           			src);
+			setup = 1;
 			goto cleanup;
 		}
 
-		gettimeofday(&start, NULL);
+		gettimeofday(&xstart, NULL);
+
+		/* Let the kernel move the data if neither side needs to see it. */
+		zcopy = l_zcopy_ok(sch->lh, dch->lh);
+		off   = xoff == (globus_off_t)-1 ? 0 : xoff;
+		zleft = xlen;
+
+		if (zcopy)
+			mx_zcopy();
+		else
+			pipeline_init(&pl, sch->lh, dch->lh);
 		while (!eof)
 		{
-			ec = l_read(sch->lh, dch->lh, &buf, &off, &len, &eof);
+			mx_now(&mxt);
+			if (zcopy)
+				ec = l_zcopy(sch->lh, dch->lh, &off, &zleft, &len, &eof);
+			else
+				ec = pipeline_read(pl, &buf, &off, &len, &eof);
+			mx_add(MX_READ, &mxt);
 			if (ec)
 			{
 				if (hashnl)
@@ -3482,7 +4394,10 @@ _c_xfer_file(ch_t * sch,
 				break;
 			}
 
-			ec = l_write(dch->lh, sch->lh, buf, off, len, eof);
+			mx_now(&mxt);
+			if (!zcopy)
+				ec = l_write(dch->lh, sch->lh, buf, off, len, eof);
+			mx_add(MX_WRITE, &mxt);
 			if (ec)
 			{
 				if (hashnl)
@@ -3494,8 +4409,25 @@ _c_xfer_file(ch_t * sch,
 				          DEBUG_ERRS_ONLY,
 				          "%s: Error writing to destination.\n",
 				          dst);
+				wfail = 1;
 				break;
 			}
+			mx_bytes(len);
+
+			/* l_zcopy() leaves off past the bytes it moved. */
+			rs_add(cur, zcopy ? off - (globus_off_t)len : off, len);
+
+			if (map && time(NULL) >= saved + C_RANGE_CHECKPOINT)
+			{
+				/*
+				 * Blocks handed to l_write() may still be queued, so the
+				 * map only counts what was written an interval ago.
+				 */
+				_c_range_save(map, done, lag, src, dst, base + slen);
+				rs_clear(lag);
+				rs_merge(lag, cur);
+				saved = time(NULL);
+			}
 
 			if (s_hash())
 			{
@@ -3509,6 +4441,8 @@ _c_xfer_file(ch_t * sch,
 			}
 		}
 		gettimeofday(&stop, NULL);
+		xusec += (long long)(stop.tv_sec - xstart.tv_sec) * 1000000 +
+		         (stop.tv_usec - xstart.tv_usec);
 
 		if (hashnl)
 		{
@@ -3517,9 +4451,49 @@ _c_xfer_file(ch_t * sch,
 		}
 
 cleanup:
+		pipeline_destroy(pl);
+		pl = NULL;
+
 		ecr = l_close(dch->lh);
 		ecl = l_close(sch->lh);
 
+		/*
+		 * What we wrote is there unless the destination complained. Count
+		 * it even if the source failed part way through.
+		 */
+		have = rs_bytes(done);
+		if (ranged && !ecr && !wfail)
+			rs_merge(done, cur);
+		rs_clear(cur);
+		rs_clear(lag);
+
+		if (!ec && !ecl && !ecr)
+		{
+			/* Carry on with the next missing range, if any. */
+			if (ranged && rs_bytes(done) > have &&
+			    rs_gap(done, base, base + slen, &xoff, &xlen))
+				continue;
+			break;
+		}
+
+		/*
+		 * A server that can not do partial transfers fails the restart
+		 * before any data moves. Start over with the whole file.
+		 */
+		if (setup && ranged && xoff != soff && !ec_retry(ec))
+		{
+			rs_clear(done);
+			ranged = 0;
+			setup  = 2;
+			continue;
+		}
+
+		if (map)
+		{
+			_c_range_save(map, done, NULL, src, dst, base + slen);
+			saved = time(NULL);
+		}
+
 		if (!ec_retry(ecl) && !ec_retry(ecr) && !ec_retry(ec))
 			break;
 
@@ -3549,8 +4523,12 @@ cleanup:
 	ec_print(ecr);
 	ec_destroy(ecr);
 
-	/* Remove the destination on error. */
-	if (cr != CMD_SUCCESS && delfile)
+	/* The map is only needed until the file is complete. */
+	if (map && cr == CMD_SUCCESS)
+		unlink(map);
+
+	/* Remove the destination on error, unless the map can restart it. */
+	if (cr != CMD_SUCCESS && delfile && !(map && rs_bytes(done)))
 	{
 		/* Stat the file. */
 		ec = l_stat(dch->lh, dst, &dmlp);
@@ -3575,6 +4553,15 @@ cleanup:
 
 	if (cr == CMD_SUCCESS)
 	{
+		/* slen covers every range, so time them all together. */
+		start.tv_sec  = stop.tv_sec - xusec / 1000000;
+		start.tv_usec = stop.tv_usec - xusec % 1000000;
+		if (start.tv_usec < 0)
+		{
+			start.tv_sec--;
+			start.tv_usec += 1000000;
+		}
+
 		buf   = Sprintf(NULL, "%"GLOBUS_OFF_T_FORMAT" bytes", slen);
 		tim   = Convtime(&start, &stop);
 		rate  = MkRate(&start, &stop, slen);
@@ -3599,6 +4586,13 @@ cleanup:
 		record_perf(sch->lh, dch->lh, src, dst, slen);
 #endif /* SYSLOG_PERF */
 
+	rs_destroy(done);
+	rs_destroy(cur);
+	rs_destroy(lag);
+	FREE(map);
+
+	mx_finish(cr == CMD_SUCCESS);
+
 	if (cr == CMD_SUCCESS && s_cksum() && *dst != '|' && *src != '|')
 	{
 		C_RETRY(ec, l_cksum(sch->lh, src, &supported, &lcrc));
@@ -3641,6 +4635,9 @@ cleanup:
 		}
 	}
 
+	if (cr == CMD_SUCCESS)
+		jn_xfer(slen, rcrc, s_cksum() && *dst != '|' && *src != '|');
+
 	return cr;
 }
 
@@ -3802,7 +4799,8 @@ retry:
 		ec = l_read(ch->lh, NULL, &buf, &off, &len, &eof);
 		if (!ec && buf)
 			o_fwrite(outf, DEBUG_ERRS_ONLY, buf, len);
-		FREE(buf);
+		pool_free(buf);
+		buf = NULL;
 	}
 
 cleanup:
@@ -61,4 +61,7 @@ typedef int cmdret_t;
 void     cmd_init(void);
 cmdret_t cmd_intrptr(char * cmd);
 
+/* 1 if the local (or remote) session's control connection has dropped. */
+int      cmd_lost(int local);
+
 #endif /* CMDS_H */
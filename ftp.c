@@ -40,6 +40,7 @@
  */
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/time.h>
 #include <sys/stat.h>
 #include <fnmatch.h>
 #include <stdlib.h>
@@ -53,10 +54,12 @@
 #include "network.h"
 #include "output.h"
 #include "misc.h"
+#include "pool.h"
 #include "ftp.h"
 #include "gsi.h"
 #include "ftp_eb.h"
 #include "ftp_s.h"
+#include "autopar.h"
 #include "ftp_a.h"
 
 #ifdef DMALLOC
@@ -72,6 +75,10 @@
 #define F_CODE_INTR(x)      ((x) >= 300 && (x) <= 399)
 #define F_CODE_UNKNOWN(x)  (((x) >= 500 && (x) <= 509) || (x) == 202)
 
+/* Bounds on TCP buffers sized by autotcpbuf. */
+#define F_TCPBUF_MIN (64 * 1024)
+#define F_TCPBUF_MAX (256 * 1024 * 1024)
+
 
 typedef struct ftp_handle {
 	int    port;
@@ -121,6 +128,14 @@ typedef struct ftp_handle {
 	int stream; /* 0 stream, 1 eb */
 	int ascii;  /* 0 binary, 1 ascii */
 
+	/* Goodput of the current transfer, reported to autoparallel. */
+	struct timeval xstart;
+	globus_off_t   xbytes;
+
+	/* Timed NOOP round trip (usec) when the kernel does not report one. */
+	long long rtt;
+	int       tcpbuf; /* TCP buffer size for the next transfer. */
+
 	/* Connection information */
 	struct sockaddr_in * sinp;
 	int scnt;
@@ -163,6 +178,9 @@ _f_get_final_resp(fh_t * fh, int * code, char ** resp);
 static errcode_t
 _f_get_resp(fh_t * fh, int * code, char ** resp);
 
+static errcode_t
+_f_rtt(fh_t * fh, long long * rtt);
+
 static errcode_t
 _f_setup_tcp(fh_t * fh, fh_t * ofh);
 
@@ -448,9 +466,16 @@ ftp_retr(pd_t * pd,
 	{
 		cmd = Sprintf(NULL, 
 		              "OPTS RETR Parallelism=%d,%d,%d;",
-		              s_parallel(),
-		              s_parallel(),
-		              s_parallel());
+		              fh->dcs.parallel,
+		              fh->dcs.parallel,
+		              fh->dcs.parallel);
+
+		/* Ask striped servers for the layout _f_eb_write() assumes. */
+		if (s_stripeblock() > 0)
+			cmd = Sprintf(cmd,
+			              "%sStripeLayout=Blocked;BlockSize=%lld;",
+			              cmd,
+			              s_stripeblock());
 
 		ec = _f_send_cmd(fh, cmd);
 		FREE(cmd);
@@ -705,6 +730,11 @@ ftp_read(pd_t          *  pd,
 	}
 
 	do {
+		if (fh->dcs.intr)
+			return ec_create(EC_GSI_SUCCESS,
+			                 EC_GSI_SUCCESS,
+			                 "Transfer interrupted");
+
 		ec = _f_keepalive(fh);
 		if (ec)
 			return ec;
@@ -739,7 +769,10 @@ ftp_read(pd_t          *  pd,
 	if (ec)
 		return ec;
 
-	return fh->dcs.dci.read(&fh->dcs, buf, off, len, eof);
+	ec = fh->dcs.dci.read(&fh->dcs, buf, off, len, eof);
+	if (!ec)
+		fh->xbytes += *len;
+	return ec;
 }
 
 static errcode_t
@@ -772,7 +805,7 @@ ftp_write(pd_t          * pd,
 		ec = _f_keepalive(fh);
 		if (ec)
 		{
-			FREE(buf);
+			pool_free(buf);
 			return ec;
 		}
 
@@ -780,7 +813,7 @@ ftp_write(pd_t          * pd,
 		ec = _f_poll_resp(fh, &code, &resp);
 		if (ec != EC_SUCCESS)
 		{
-			FREE(buf);
+			pool_free(buf);
 			return ec;
 		}
 
@@ -794,7 +827,7 @@ ftp_write(pd_t          * pd,
 				ec_set_flag(ec, EC_FLAG_CAN_RETRY);
 
 			FREE(resp);
-			FREE(buf);
+			pool_free(buf);
 			return ec;
 		}
 		FREE(resp);
@@ -807,9 +840,106 @@ ftp_write(pd_t          * pd,
 	if (ec)
 		return ec;
 
+	fh->xbytes += len;
 	return fh->dcs.dci.write(&fh->dcs, buf, off, len, eof);
 }
 
+/*
+ * Zero copy is possible when the data channel is in stream mode, is not
+ * translating ascii and carries clear data.
+ */
+static int
+ftp_zcopy(pd_t * pd)
+{
+	fh_t * fh = (fh_t *) pd->ftppriv;
+
+	if (!fh->stream || fh->ascii)
+		return 0;
+
+	if (!fh->dcs.dci.sendfile || !fh->dcs.dci.recvfile)
+		return 0;
+
+	return !fh->dcs.dcau || !s_prot();
+}
+
+/* Keepalive and error checks made between blocks of a transfer. */
+static errcode_t
+_f_check_cc(fh_t * fh)
+{
+	int         code  = 0;
+	char      * resp  = NULL;
+	errcode_t   ec    = EC_SUCCESS;
+
+	ec = _f_keepalive(fh);
+	if (ec)
+		return ec;
+
+	/* Check the control channel for messages. */
+	ec = _f_poll_resp(fh, &code, &resp);
+	if (ec)
+		return ec;
+
+	if (F_CODE_ERR(code))
+	{
+		ec = ec_create(EC_GSI_SUCCESS,
+		               EC_GSI_SUCCESS,
+		               "%s",
+		               resp);
+		if (F_CODE_TRANS_ERR(code))
+			ec_set_flag(ec, EC_FLAG_CAN_RETRY);
+	}
+	FREE(resp);
+	return ec;
+}
+
+static errcode_t
+ftp_sendfile(pd_t          * pd,
+             int             fd,
+             globus_off_t    off,
+             size_t        * len,
+             int           * eof)
+{
+	fh_t      * fh    = (fh_t *) pd->ftppriv;
+	errcode_t   ec    = EC_SUCCESS;
+	size_t      want  = *len;
+
+	/* The channel only waits a while, so the control channel is tended. */
+	do {
+		ec = _f_check_cc(fh);
+		if (ec)
+			return ec;
+
+		*len = want;
+		ec = fh->dcs.dci.sendfile(&fh->dcs, fd, off, len, eof);
+	} while (!ec && *len == 0 && !*eof);
+
+	return ec;
+}
+
+static errcode_t
+ftp_recvfile(pd_t          * pd,
+             int             fd,
+             globus_off_t  * off,
+             size_t        * len,
+             int           * eof)
+{
+	fh_t      * fh    = (fh_t *) pd->ftppriv;
+	errcode_t   ec    = EC_SUCCESS;
+	size_t      want  = *len;
+
+	/* The channel only waits a while, so the control channel is tended. */
+	do {
+		ec = _f_check_cc(fh);
+		if (ec)
+			return ec;
+
+		*len = want;
+		ec = fh->dcs.dci.recvfile(&fh->dcs, fd, off, len, eof);
+	} while (!ec && *len == 0 && !*eof);
+
+	return ec;
+}
+
 static errcode_t
 ftp_close(pd_t * pd)
 {
@@ -819,6 +949,7 @@ ftp_close(pd_t * pd)
 	int    retcode = 0;
 	char * resp    = NULL;
 	char * retresp = NULL;
+	struct timeval now;
 
 	if (fh->sinp)
 	{
@@ -856,7 +987,21 @@ ftp_close(pd_t * pd)
 		}
 		FREE(retresp);
 	}
+
+	/* Report the goodput of extended block transfers to autoparallel. */
+	if (ec == EC_SUCCESS && !fh->stream && fh->xbytes > 0)
+	{
+		gettimeofday(&now, NULL);
+		ap_update(fh->host,
+		          fh->dcs.parallel,
+		          fh->xbytes,
+		          (long long)(now.tv_sec - fh->xstart.tv_sec) * 1000000 +
+		          (now.tv_usec - fh->xstart.tv_usec));
+	}
+	fh->xbytes = 0;
+
 	fh->keepalive = 0;
+	fh->dcs.intr  = 0;
 	memset(&fh->dcs.dci, 0, sizeof(dci_t));
 
 	return ec;
@@ -2361,6 +2506,57 @@ ftp_lsfam (pd_t * pd, char ** families)
 	return EC_SUCCESS;
 }
 
+static void
+ftp_detach(pd_t * pd)
+{
+	fh_t * fh = (fh_t *) pd->ftppriv;
+
+	if (fh == NULL)
+		return;
+
+	/*
+	 * The session belongs to the process we were forked from, so close our
+	 * copy of the socket without sending QUIT. Clearing nh (rather than just
+	 * closing it) keeps _f_connect() from announcing a reconnect when the
+	 * next command opens a session of our own.
+	 */
+	net_destroy(fh->cc.nh);
+	fh->cc.nh = NULL;
+}
+
+static char *
+ftp_url(pd_t * pd, char * path)
+{
+	fh_t * fh = (fh_t *) pd->ftppriv;
+
+	return Sprintf(NULL,
+	               "%s://%s%s%s:%d%s",
+	               fh->pass ? "ftp" : "gsiftp",
+	               fh->user ? fh->user : "",
+	               fh->user ? "@"      : "",
+	               fh->host,
+	               fh->port,
+	               path);
+}
+
+/* Failed commands close the control channel so the next one reconnects. */
+static int
+ftp_lost(pd_t * pd)
+{
+	fh_t * fh = (fh_t *) pd->ftppriv;
+
+	return !net_connected(fh->cc.nh);
+}
+
+/* The data channel waits notice dcs.intr; see ftp_read() and _f_eb_wait(). */
+static void
+ftp_interrupt(pd_t * pd)
+{
+	fh_t * fh = (fh_t *) pd->ftppriv;
+
+	fh->dcs.intr = 1;
+}
+
 #ifdef SYSLOG_PERF
 char *
 ftp_rhost(pd_t * pd)
@@ -2402,6 +2598,14 @@ const Linterface_t FtpInterface = {
 	ftp_utime,
 	ftp_lscos,
 	ftp_lsfam,
+	ftp_detach,
+	NULL, /* fileno */
+	ftp_zcopy,
+	ftp_sendfile,
+	ftp_recvfile,
+	ftp_url,
+	ftp_lost,
+	ftp_interrupt,
 #ifdef SYSLOG_PERF
 	ftp_rhost,
 #endif /* SYSLOG_PERF */
@@ -2759,6 +2963,48 @@ _f_get_resp(fh_t * fh, int * code, char ** resp)
 	return ec;
 }
 
+/*
+ * Round trip time of fh's control channel in microseconds. The kernel's
+ * smoothed estimate is used when it has one; otherwise a NOOP is timed
+ * once per connection. 0 if neither is available.
+ */
+static errcode_t
+_f_rtt(fh_t * fh, long long * rtt)
+{
+	int            code = 0;
+	char         * resp = NULL;
+	errcode_t      ec   = EC_SUCCESS;
+	struct timeval start;
+	struct timeval end;
+
+	*rtt = net_rtt(fh->cc.nh);
+	if (*rtt)
+		return EC_SUCCESS;
+
+	if (!fh->rtt)
+	{
+		gettimeofday(&start, NULL);
+
+		ec = _f_send_cmd(fh, "NOOP");
+		if (ec)
+			return ec;
+
+		ec = _f_get_final_resp(fh, &code, &resp);
+		if (ec)
+			return ec;
+		FREE(resp);
+
+		gettimeofday(&end, NULL);
+		fh->rtt = (long long)(end.tv_sec - start.tv_sec) * 1000000 +
+		          (end.tv_usec - start.tv_usec);
+		if (fh->rtt <= 0)
+			fh->rtt = 1;
+	}
+
+	*rtt = fh->rtt;
+	return EC_SUCCESS;
+}
+
 static errcode_t
 _f_setup_tcp(fh_t * fh, fh_t * ofh)
 {
@@ -2767,8 +3013,46 @@ _f_setup_tcp(fh_t * fh, fh_t * ofh)
 	char      * resp  = NULL;
 	char      * cmd   = NULL;
 	errcode_t   ec    = EC_SUCCESS;
+	long long   rtt   = 0;
+	long long   ortt  = 0;
+	long long   bdp   = 0;
 
 	wsize = s_tcpbuf();
+
+	/*
+	 * Size the buffers to the bandwidth delay product of the path. For
+	 * third party transfers the servers' path is unknown; the longer of
+	 * our two round trips stands in for it.
+	 */
+	if (s_autotcpbuf())
+	{
+		ec = _f_rtt(fh, &rtt);
+		if (!ec && ofh)
+			ec = _f_rtt(ofh, &ortt);
+		if (ec)
+			return ec;
+
+		if (ortt > rtt)
+			rtt = ortt;
+
+		if (rtt)
+		{
+			bdp = s_autotcpbuf() * rtt / 1000000;
+			if (bdp < F_TCPBUF_MIN)
+				bdp = F_TCPBUF_MIN;
+			if (bdp > F_TCPBUF_MAX)
+				bdp = F_TCPBUF_MAX;
+			wsize = (int) bdp;
+
+			o_printf(DEBUG_VERBOSE,
+			         "%s: round trip %lld usec, TCP buffer %d bytes\n",
+			         fh->host,
+			         rtt,
+			         wsize);
+		}
+	}
+
+	fh->tcpbuf = wsize;
 	if (!wsize)
 		return EC_SUCCESS;
 
@@ -2993,8 +3277,14 @@ _f_setup_type(fh_t * fh, fh_t * ofh, int binary)
 static errcode_t
 _f_setup_dci(fh_t * fh, fh_t * ofh)
 {
+	fh->dcs.parallel = ap_parallel(fh->host);
+	fh->dcs.tcpbuf   = fh->tcpbuf;
+	fh->xbytes = 0;
+	gettimeofday(&fh->xstart, NULL);
+
 	if (ofh)
 		return EC_SUCCESS;
+	fh->dcs.cc = fh->cc.nh;
 	if (fh->ascii)
 		fh->dcs.dci = Ftp_a_dci;
 	else if (fh->stream)
@@ -3563,6 +3853,9 @@ _f_connect(fh_t * fh, char ** srvrmsg)
 	if (net_connected(fh->cc.nh))
 		return ec;
 
+	/* Time the new connection's round trip afresh. */
+	fh->rtt = 0;
+
 	if (fh->cc.nh)
 		o_printf(DEBUG_NORMAL, "Reconnecting...\n");
 
@@ -3580,7 +3873,7 @@ _f_connect(fh_t * fh, char ** srvrmsg)
 	if (ec != EC_SUCCESS)
 		goto cleanup;
 
-	ec = net_connect(&fh->cc.nh, &sin);
+	ec = net_connect(&fh->cc.nh, &sin, s_tcpbuf());
 	if (ec != EC_SUCCESS)
 		goto cleanup;
 
@@ -3800,7 +4093,8 @@ _f_readdir_mlsd(pd_t * pd, char * path, ml_t *** mlp, char * token)
 			break;
 
 		listing = Strncat(listing, buf, len);
-		FREE(buf);
+		pool_free(buf);
+		buf = NULL;
 	}
 
 	if (ec)
@@ -3940,7 +4234,8 @@ _f_readdir_nlst(pd_t * pd, char * path, ml_t *** mlpp, char * token)
 			break;
 
 		listing = Strncat(listing, buf, len);
-		FREE(buf);
+		pool_free(buf);
+		buf = NULL;
 	}
 
 	ec2 = ftp_close(pd);
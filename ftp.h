@@ -68,6 +68,17 @@ typedef struct _dci_h {
 	                   globus_size_t len,
 	                   int eof);
 	void (*close)(dch_t *);
+	/* Optional, move file data without copying it through user space. */
+	errcode_t (*sendfile)(dch_t *,
+	                      int             fd,
+	                      globus_off_t    off,
+	                      globus_size_t * len,
+	                      int           * eof);
+	errcode_t (*recvfile)(dch_t *,
+	                      int             fd,
+	                      globus_off_t  * off,
+	                      globus_size_t * len,
+	                      int           * eof);
 } dci_t;
 
 /* Handle for all data channels. */
@@ -77,6 +88,10 @@ struct _dch_ {
 	int      pbsz; /* Protection buffer size */
 	int      dcau; /* 0 no, 1 yes. */ /* Use s_dcau() for settings. */
 	globus_off_t partial_off;
+	nh_t   * cc;   /* Control channel, so waits wake on server replies. */
+	int      parallel; /* Streams per stripe for this transfer. */
+	int      tcpbuf;   /* TCP buffer size for this transfer, 0 default. */
+	volatile int intr; /* Set by another thread to end a read. */
 };
 
 #endif /* UBER_FTP_H */
@@ -47,8 +47,10 @@
 #include "output.h"
 #include "ftp_a.h"
 #include "misc.h"
+#include "pool.h"
 #include "gsi.h"
 #include "ftp.h"
+#include "ratelimit.h"
 
 #ifdef DMALLOC
 #include "dmalloc.h"
@@ -118,7 +120,7 @@ _f_a_active(dch_t * dch, struct sockaddr_in * sin, int scnt)
 	memset(dc, 0, sizeof(dc_t));
 
 	/* Non blocking connect. */
-	ec = net_connect(&dc->nh, sin);
+	ec = net_connect(&dc->nh, sin, dch->tcpbuf);
 	if (ec)
 	{
 		FREE(dch->privdata);
@@ -140,7 +142,7 @@ _f_a_passive(dch_t * dch, struct sockaddr_in * sin)
 	dch->privdata = dc = (dc_t*) malloc(sizeof(dc_t));
 	memset(dc, 0, sizeof(dc_t));
 
-	ec = net_listen(&dc->nh, sin);
+	ec = net_listen(&dc->nh, sin, dch->tcpbuf);
 	if (ec)
 	{
 		FREE(dch->privdata);
@@ -164,8 +166,12 @@ _f_a_read_ready(dch_t * dch, int * ready)
 	if (ec || dc->state != DC_STATE_RD_WR)
 		return ec;
 
+	/* A single stream can wait out the rate limit right here. */
 	if (!gsi_dc_ready(dc->gh, dc->nh, 1))
+	{
+		rl_pause();
 		ec = gsi_dc_fl_read(dc->gh, dc->nh);
+	}
 	if (ec)
 		return ec;
 
@@ -191,6 +197,7 @@ _f_a_read(dch_t         * dch,
 
 	while (!ec && !gsi_dc_ready(dc->gh, dc->nh, 1))
 	{
+		rl_pause();
 		ec = gsi_dc_fl_read(dc->gh, dc->nh);
 	}
 	if (ec)
@@ -225,8 +232,12 @@ _f_a_write_ready(dch_t * dch, int * ready)
 	if (ec || dc->state != DC_STATE_RD_WR)
 		return ec;
 
+	/* A single stream can wait out the rate limit right here. */
 	if (!gsi_dc_ready(dc->gh, dc->nh, 0))
+	{
+		rl_pause();
 		ec = gsi_dc_fl_write(dc->gh, dc->nh);
+	}
 	if (ec)
 		return ec;
 
@@ -253,6 +264,7 @@ _f_a_write(dch_t * dch,
 
 	while (!ec && !gsi_dc_ready(dc->gh, dc->nh, 0))
 	{
+		rl_pause();
 		ec = gsi_dc_fl_write(dc->gh, dc->nh);
 	}
 
@@ -266,7 +278,7 @@ _f_a_write(dch_t * dch,
 		if (!cptr)
 			break;
 
-		buf = (char *) realloc(buf, len+1);
+		buf = pool_realloc(buf, len+1);
 		memmove(cptr+1, cptr, len - (cptr-buf));
 		*cptr = '\r';
 		cptr += 2;
@@ -295,6 +307,7 @@ _f_a_close(dch_t * dch)
 		ec_destroy(ec);
 	}
 
+	gsi_dc_release(dc->gh, dc->nh);
 	net_destroy(dc->nh);
 	gsi_destroy(dc->gh);
 	FREE(dc);
@@ -310,5 +323,7 @@ const dci_t Ftp_a_dci = {
 	_f_a_write_ready,
 	_f_a_write,
 	_f_a_close,
+	NULL, /* sendfile */
+	NULL, /* recvfile */
 };
 
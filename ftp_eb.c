@@ -64,8 +64,11 @@
 #include "output.h"
 #include "ftp_eb.h"
 #include "misc.h"
+#include "pool.h"
 #include "gsi.h"
 #include "ftp.h"
+#include "metrics.h"
+#include "ratelimit.h"
 
 #ifdef DMALLOC
 #include "dmalloc.h"
@@ -79,9 +82,7 @@
 #define DC_STATE_READ_READY    0x05
 
 #define DC_STATE_READY         0x10
-#define DC_STATE_PUSH_HEADER   0x20
-#define DC_STATE_FLUSH_HEADER  0x30
-#define DC_STATE_PUSH_DATA     0x40
+#define DC_STATE_PUSH_BLOCK    0x20
 #define DC_STATE_FLUSH_DATA    0x50
 #define DC_STATE_PUSH_EOF      0x60
 #define DC_STATE_FLUSH_EOF     0x70
@@ -91,16 +92,40 @@
 
 #define EB_HEADER_LEN (1+8+8)
 
+/* Reactor timer that wakes the ready functions for keepalives. */
+#define EB_TIMER_KEEPALIVE 0
+
+/* Reactor timer that wakes throttled channels when the rate limit refills. */
+#define EB_TIMER_RATE 1
+
+/* Longest sleep in _f_eb_wait(), so that it notices dch->intr. */
+#define EB_WAIT_MAX 1000
+
+/*
+ * Received data is kept as a chain of the blocks handed up by gsi_dc_read().
+ * Headers are parsed where they sit and consumed by moving the cursor, so
+ * each byte is copied at most once on its way to the caller.
+ */
+typedef struct _seg_ {
+	struct _seg_ * next;
+	char         * buf;
+	size_t         off; /* First unconsumed byte. */
+	size_t         len;
+} seg_t;
+
 typedef struct _dc_ {
     nh_t * nh;
 	gh_t * gh;
-	char * buf;
-	int    buflen;
+	char * buf;    /* Block being sent. */
+	seg_t * head;  /* Blocks received. */
+	seg_t * tail;
+	int    buflen; /* Bytes in buf or unconsumed bytes in head..tail. */
     int    state; /* 0 read/write, 1 listen, 2 connect */
 	int    eod;
 	int    eof;
 	globus_off_t off;
 	globus_off_t count;
+	globus_off_t sent; /* Bytes handed to this channel by _f_eb_write(). */
 } dc_t;
 
 typedef struct {
@@ -108,8 +133,26 @@ typedef struct {
 	int    dccnt;
 	int    eods;
 	int    eeods;
+	int     parallel; /* Streams per stripe, sent in the EOF header. */
+	int     scnt;     /* Stripes; dcs[s * parallel] starts stripe s. */
+	nr_t  * nr;       /* Data channels and the control channel. */
 } ebpd_t;
 
+static void
+_f_eb_seg_append(dc_t * dc, char * buf, size_t len);
+
+static void
+_f_eb_seg_copy(dc_t * dc, char * dst, size_t len);
+
+static void
+_f_eb_seg_consume(dc_t * dc, size_t len);
+
+static void
+_f_eb_seg_take(dc_t * dc, size_t max, char ** buf, size_t * len);
+
+static void
+_f_eb_seg_free(dc_t * dc);
+
 static errcode_t
 _f_eb_read_pullup(dc_t * dc);
 
@@ -119,11 +162,17 @@ _f_eb_header_pullup(ebpd_t * ebpd, dc_t * dc);
 static errcode_t
 _f_eb_poll(dch_t * dch);
 
+static errcode_t
+_f_eb_wait(dch_t * dch, int cc);
+
+static errcode_t
+_f_eb_poll_dcs(dch_t * dch);
+
 static char *
 _f_eb_header(char desc, globus_off_t count, globus_off_t off);
 
 static errcode_t
-_f_eb_push_header(ebpd_t * ebpd, dc_t * dc);
+_f_eb_push_block(ebpd_t * ebpd, dc_t * dc);
 
 static errcode_t
 _f_eb_push_eod(ebpd_t * ebpd, dc_t * dc);
@@ -131,8 +180,6 @@ _f_eb_push_eod(ebpd_t * ebpd, dc_t * dc);
 static errcode_t
 _f_eb_push_eof(ebpd_t * ebpd, dc_t * dc);
 
-static errcode_t
-_f_eb_push_data(ebpd_t * ebpd, dc_t * dc);
 
 static errcode_t
 _f_eb_active(dch_t * dch, struct sockaddr_in * sin, int scnt)
@@ -145,15 +192,21 @@ _f_eb_active(dch_t * dch, struct sockaddr_in * sin, int scnt)
 	dch->privdata = ebpd = (ebpd_t*) malloc(sizeof(ebpd_t));
 	memset(ebpd, 0, sizeof(ebpd_t));
 
-	ebpd->dcs = (dc_t*) malloc(sizeof(dc_t) * (scnt * s_parallel()));
-	memset(ebpd->dcs, 0, sizeof(dc_t) * (scnt * s_parallel()));
+	ebpd->parallel = dch->parallel;
+	ebpd->scnt     = scnt;
+
+	ec = nr_init(&ebpd->nr);
+	if (ec)
+		return ec;
+	ebpd->dcs = (dc_t*) malloc(sizeof(dc_t) * (scnt * ebpd->parallel));
+	memset(ebpd->dcs, 0, sizeof(dc_t) * (scnt * ebpd->parallel));
 
 	for (s = 0; s < scnt; s++)
 	{
-		for (p = 0; p < s_parallel(); p++)
+		for (p = 0; p < ebpd->parallel; p++)
 		{
 			/* Non blocking connect. */
-			ec = net_connect(&ebpd->dcs[ebpd->dccnt].nh, &sin[s]);
+			ec = net_connect(&ebpd->dcs[ebpd->dccnt].nh, &sin[s], dch->tcpbuf);
 			if (ec)
 				return ec;
 
@@ -174,10 +227,16 @@ _f_eb_passive(dch_t * dch, struct sockaddr_in * sin)
 	dch->privdata = ebpd = (ebpd_t*) malloc(sizeof(ebpd_t));
 	memset(ebpd, 0, sizeof(ebpd_t));
 
+	ebpd->parallel = dch->parallel;
+	ebpd->scnt     = 1;
+
+	ec = nr_init(&ebpd->nr);
+	if (ec)
+		return ec;
 	ebpd->dcs = (dc_t*) malloc(sizeof(dc_t));
 	memset(ebpd->dcs, 0, sizeof(dc_t));
 
-	ec = net_listen(&ebpd->dcs[0].nh, sin);
+	ec = net_listen(&ebpd->dcs[0].nh, sin, dch->tcpbuf);
 	if (ec)
 		return ec;
 
@@ -235,6 +294,10 @@ _f_eb_read_ready(dch_t * dch, int * ready)
 		}
 	}
 
+	/* Sleep until a channel or the control channel has something. */
+	if (*ready == 0)
+		return _f_eb_wait(dch, 1);
+
 	return EC_SUCCESS;
 }
 
@@ -302,6 +365,10 @@ _f_eb_read(dch_t        * dch,
 					return EC_SUCCESS;
 				}
 			}
+
+			ec = _f_eb_wait(dch, 0);
+			if (ec)
+				return ec;
 		}
 	}
 
@@ -320,34 +387,17 @@ _f_eb_read(dch_t        * dch,
 	 */
  
 
-	/* If we have more data than this block holds... */
-	if (dc->buflen > dc->count)
-	{
-		/* This would be illegal. */
-		assert(dc->eod == 0);
-
-		/* Copy it out. */
-		*buf = malloc(dc->count);
-		*len = dc->count;
-		*off = dc->off;
-		memcpy(*buf, dc->buf, dc->count);
-		memmove(dc->buf, dc->buf + dc->count, dc->buflen - dc->count);
-		dc->buflen -= dc->count;
-		dc->off    += dc->count;
-		dc->count   = 0;
-	} else
-	{
-		/* Give them the actual buffer. */
-		*len       = dc->buflen;
-		*buf       = dc->buf;
-		*off       = dc->off;
-		dc->buf    = NULL;
-		dc->count -= dc->buflen;
-		dc->off   += dc->buflen;
-		dc->buflen = 0;
-	}
+	/* Data past the end of this block would be illegal after EOD. */
+	assert(dc->buflen <= dc->count || dc->eod == 0);
+
+	/* Hand out as much of the block as the first segment holds. */
+	_f_eb_seg_take(dc, dc->count, buf, len);
+	*off       = dc->off;
+	dc->count -= *len;
+	dc->off   += *len;
 
 	*off += dch->partial_off;
+	mx_chan(dc - ebpd->dcs, -1, *len);
 
 	if (dc->eod == 1 && dc->count == 0)
 	{
@@ -403,7 +453,9 @@ _f_eb_write_ready(dch_t * dch, int * ready)
 			return ec;
 		}
 	}
-	return ec;
+
+	/* Sleep until a channel drains or the control channel has something. */
+	return _f_eb_wait(dch, 1);
 }
 
 static errcode_t
@@ -417,6 +469,16 @@ _f_eb_write(dch_t        * dch,
 	dc_t    * dc   = NULL;
 	ebpd_t  * ebpd = (ebpd_t *) dch->privdata;
 	int       i    = 0;
+	int       unsent = 0;
+	int       least  = 0;
+	int       stripe = -1;
+
+	/*
+	 * With a known layout, a block goes to the stripe that holds its file
+	 * offset so the server's nodes do not forward it among themselves.
+	 */
+	if (ebpd->scnt > 1 && s_stripeblock() > 0)
+		stripe = (off / s_stripeblock()) % ebpd->scnt;
 
 	off -= dch->partial_off;
 
@@ -428,18 +490,52 @@ _f_eb_write(dch_t        * dch,
 			if (ec)
 				return ec;
 
-			for (i = 0; !dc && i < ebpd->dccnt; i++)
+			/*
+			 * Of the ready channels, pick the one with the least data still
+			 * waiting in its socket. A stream slowed by loss keeps a full
+			 * send queue and stops getting blocks until it drains. Ties (or
+			 * no SIOCOUTQ) go to the channel that has been handed the
+			 * fewest bytes.
+			 */
+			for (i = 0; i < ebpd->dccnt; i++)
 			{
-				if (ebpd->dcs[i].state == DC_STATE_READY)
-					dc = &ebpd->dcs[i];
+				if (ebpd->dcs[i].state != DC_STATE_READY)
+					continue;
+
+				if (stripe >= 0 && i / ebpd->parallel != stripe)
+					continue;
+
+				unsent = net_unsent(ebpd->dcs[i].nh);
+				if (!dc ||
+				    unsent < least ||
+				    (unsent == least && ebpd->dcs[i].sent < dc->sent))
+				{
+					dc    = &ebpd->dcs[i];
+					least = unsent;
+				}
+			}
+
+			if (!dc)
+			{
+				ec = _f_eb_wait(dch, 0);
+				if (ec)
+					return ec;
 			}
 		}
 
+		dc->sent  += len;
 		dc->buf    = buf;
 		dc->off    = off;
 		dc->count  = len;
 		dc->buflen = len;
-		dc->state  = DC_STATE_PUSH_HEADER;
+		dc->state  = DC_STATE_PUSH_BLOCK;
+		mx_chan(dc - ebpd->dcs,
+		        ebpd->scnt > 1 ? (dc - ebpd->dcs) / ebpd->parallel : -1,
+		        len);
+	} else
+	{
+		/* We own the buffer even if there is nothing to send. */
+		pool_free(buf);
 	}
 
 	/* Set state to WRITE_PUSH */
@@ -447,11 +543,13 @@ _f_eb_write(dch_t        * dch,
 		return ec;
 
 	/* Flush data. Send EOF once to each server. */
-	for (i = 0; i < ebpd->dccnt; i += s_parallel())
+	for (i = 0; i < ebpd->dccnt; i += ebpd->parallel)
 	{
 		while (ebpd->dcs[i].state != DC_STATE_READY)
 		{
 			ec = _f_eb_poll(dch);
+			if (!ec && ebpd->dcs[i].state != DC_STATE_READY)
+				ec = _f_eb_wait(dch, 0);
 			if (ec)
 				return ec;
 		}
@@ -464,6 +562,8 @@ _f_eb_write(dch_t        * dch,
 		while (ebpd->dcs[i].state != DC_STATE_READY)
 		{
 			ec = _f_eb_poll(dch);
+			if (!ec && ebpd->dcs[i].state != DC_STATE_READY)
+				ec = _f_eb_wait(dch, 0);
 			if (ec)
 				return ec;
 		}
@@ -476,6 +576,8 @@ _f_eb_write(dch_t        * dch,
 		while (ebpd->dcs[i].state != DC_STATE_EOD)
 		{
 			ec = _f_eb_poll(dch);
+			if (!ec && ebpd->dcs[i].state != DC_STATE_EOD)
+				ec = _f_eb_wait(dch, 0);
 			if (ec)
 				return ec;
 		}
@@ -508,11 +610,15 @@ _f_eb_close(dch_t * dch)
 			} while (ec == EC_SUCCESS && !wr && !rd);
 			ec_destroy(ec);
 		}
-		FREE(ebpd->dcs[i].buf);
+		pool_free(ebpd->dcs[i].buf);
+		ebpd->dcs[i].buf = NULL;
+		_f_eb_seg_free(&ebpd->dcs[i]);
+		gsi_dc_release(ebpd->dcs[i].gh, ebpd->dcs[i].nh);
 		net_destroy(ebpd->dcs[i].nh);
 		gsi_destroy(ebpd->dcs[i].gh);
 	}
 
+	nr_destroy(ebpd->nr);
 	FREE(ebpd->dcs);
 	FREE(dch->privdata);
 	dch->privdata = NULL;
@@ -527,6 +633,8 @@ const dci_t Ftp_eb_dci = {
 	_f_eb_write_ready,
 	_f_eb_write,
 	_f_eb_close,
+	NULL, /* sendfile */
+	NULL, /* recvfile */
 };
 
 static errcode_t
@@ -556,12 +664,131 @@ _f_eb_read_pullup(dc_t * dc)
 	if (eof)
 		dc->eof = eof;
 
-	dc->buf = (char *) realloc(dc->buf, dc->buflen + len);
-	memcpy(dc->buf + dc->buflen, buf, len);
+	_f_eb_seg_append(dc, buf, len);
+	return ec;
+}
+
+static void
+_f_eb_seg_append(dc_t * dc, char * buf, size_t len)
+{
+	seg_t * seg = NULL;
+
+	if (!len)
+	{
+		pool_free(buf);
+		return;
+	}
+
+	seg = (seg_t *) malloc(sizeof(seg_t));
+	seg->next = NULL;
+	seg->buf  = buf;
+	seg->off  = 0;
+	seg->len  = len;
+
+	if (dc->tail)
+		dc->tail->next = seg;
+	else
+		dc->head = seg;
+	dc->tail = seg;
 	dc->buflen += len;
-	Free(buf);
+}
 
-	return ec;
+/* Copy len unconsumed bytes (len <= buflen) without consuming them. */
+static void
+_f_eb_seg_copy(dc_t * dc, char * dst, size_t len)
+{
+	seg_t * seg = NULL;
+	size_t  cnt = 0;
+
+	for (seg = dc->head; len > 0; seg = seg->next)
+	{
+		cnt = seg->len - seg->off;
+		if (cnt > len)
+			cnt = len;
+
+		memcpy(dst, seg->buf + seg->off, cnt);
+		dst += cnt;
+		len -= cnt;
+	}
+}
+
+static void
+_f_eb_seg_consume(dc_t * dc, size_t len)
+{
+	seg_t * seg = NULL;
+	size_t  cnt = 0;
+
+	while (len > 0)
+	{
+		seg = dc->head;
+		cnt = seg->len - seg->off;
+		if (cnt > len)
+			cnt = len;
+
+		seg->off   += cnt;
+		dc->buflen -= cnt;
+		len        -= cnt;
+
+		if (seg->off == seg->len)
+		{
+			dc->head = seg->next;
+			if (!dc->head)
+				dc->tail = NULL;
+			pool_free(seg->buf);
+			FREE(seg);
+		}
+	}
+}
+
+/*
+ * Remove up to max bytes from the first segment. An untouched segment that
+ * fits is handed over as is; otherwise the bytes are copied to a new block.
+ */
+static void
+_f_eb_seg_take(dc_t * dc, size_t max, char ** buf, size_t * len)
+{
+	seg_t * seg = dc->head;
+
+	*buf = NULL;
+	*len = 0;
+
+	if (!seg)
+		return;
+
+	*len = seg->len - seg->off;
+	if (*len > max)
+		*len = max;
+
+	if (seg->off == 0 && *len == seg->len)
+	{
+		*buf = seg->buf;
+		seg->buf = NULL;
+		dc->buflen -= *len;
+		dc->head = seg->next;
+		if (!dc->head)
+			dc->tail = NULL;
+		FREE(seg);
+		return;
+	}
+
+	*buf = pool_alloc(*len);
+	memcpy(*buf, seg->buf + seg->off, *len);
+	_f_eb_seg_consume(dc, *len);
+}
+
+static void
+_f_eb_seg_free(dc_t * dc)
+{
+	seg_t * seg = NULL;
+
+	while ((seg = dc->head))
+	{
+		dc->head = seg->next;
+		pool_free(seg->buf);
+		FREE(seg);
+	}
+	dc->tail   = NULL;
+	dc->buflen = 0;
 }
 
 static errcode_t
@@ -569,6 +796,7 @@ _f_eb_header_pullup(ebpd_t * ebpd, dc_t * dc)
 {
 	errcode_t     ec   = EC_SUCCESS;
 	int           desc = 0;
+	unsigned char hdr[EB_HEADER_LEN];
 
 	ec = _f_eb_read_pullup(dc);
 	if (ec)
@@ -577,12 +805,16 @@ _f_eb_header_pullup(ebpd_t * ebpd, dc_t * dc)
 	if (dc->buflen < EB_HEADER_LEN)
 		return ec;
 
+	/* Only the header is copied; it may span two segments. */
+	_f_eb_seg_copy(dc, (char *)hdr, EB_HEADER_LEN);
+	_f_eb_seg_consume(dc, EB_HEADER_LEN);
+
 	/* Initialize the count and offset. */
 	dc->count = 0;
 	dc->off   = 0;
 
 	/* Find the descriptor field. */
-	desc = (int) dc->buf[0];
+	desc = (int) hdr[0];
 
 	/* Eod */
 	if (desc & 0x08)
@@ -595,13 +827,10 @@ _f_eb_header_pullup(ebpd_t * ebpd, dc_t * dc)
 	 */
 	if (desc & 0x40)
 	{
-		ebpd->eeods = (((int)dc->buf[13]) << 24) +
-		              (((int)dc->buf[14]) << 16) +
-		              (((int)dc->buf[15]) <<  8) +
-		              (((int)dc->buf[16]));
-
-		memmove(dc->buf, dc->buf + EB_HEADER_LEN, dc->buflen - EB_HEADER_LEN);
-		dc->buflen -= EB_HEADER_LEN;
+		ebpd->eeods = (((int)hdr[13]) << 24) +
+		              (((int)hdr[14]) << 16) +
+		              (((int)hdr[15]) <<  8) +
+		              (((int)hdr[16]));
 
 		/*
 		 * If we received EOD, we are done (since we can not receive more data
@@ -616,26 +845,23 @@ _f_eb_header_pullup(ebpd_t * ebpd, dc_t * dc)
 		return ec;
 	}
 
-	dc->count = (((globus_off_t)dc->buf[1] & 0xFF) << 56) +
-	            (((globus_off_t)dc->buf[2] & 0xFF) << 48) +
-	            (((globus_off_t)dc->buf[3] & 0xFF) << 40) +
-	            (((globus_off_t)dc->buf[4] & 0xFF) << 32) +
-	            (((globus_off_t)dc->buf[5] & 0xFF) << 24) +
-	            (((globus_off_t)dc->buf[6] & 0xFF) << 16) +
-	            (((globus_off_t)dc->buf[7] & 0xFF) <<  8) +
-	            (((globus_off_t)dc->buf[8] & 0xFF));
-
-	dc->off = (((globus_off_t)dc->buf[9]  & 0xFF) << 56) +
-	          (((globus_off_t)dc->buf[10] & 0xFF) << 48) +
-	          (((globus_off_t)dc->buf[11] & 0xFF) << 40) +
-	          (((globus_off_t)dc->buf[12] & 0xFF) << 32) +
-	          (((globus_off_t)dc->buf[13] & 0xFF) << 24) +
-	          (((globus_off_t)dc->buf[14] & 0xFF) << 16) +
-	          (((globus_off_t)dc->buf[15] & 0xFF) <<  8) +
-	          (((globus_off_t)dc->buf[16] & 0xFF));
-
-	memmove(dc->buf, dc->buf + EB_HEADER_LEN, dc->buflen - EB_HEADER_LEN);
-	dc->buflen -= EB_HEADER_LEN;
+	dc->count = (((globus_off_t)hdr[1] & 0xFF) << 56) +
+	            (((globus_off_t)hdr[2] & 0xFF) << 48) +
+	            (((globus_off_t)hdr[3] & 0xFF) << 40) +
+	            (((globus_off_t)hdr[4] & 0xFF) << 32) +
+	            (((globus_off_t)hdr[5] & 0xFF) << 24) +
+	            (((globus_off_t)hdr[6] & 0xFF) << 16) +
+	            (((globus_off_t)hdr[7] & 0xFF) <<  8) +
+	            (((globus_off_t)hdr[8] & 0xFF));
+
+	dc->off = (((globus_off_t)hdr[9]  & 0xFF) << 56) +
+	          (((globus_off_t)hdr[10] & 0xFF) << 48) +
+	          (((globus_off_t)hdr[11] & 0xFF) << 40) +
+	          (((globus_off_t)hdr[12] & 0xFF) << 32) +
+	          (((globus_off_t)hdr[13] & 0xFF) << 24) +
+	          (((globus_off_t)hdr[14] & 0xFF) << 16) +
+	          (((globus_off_t)hdr[15] & 0xFF) <<  8) +
+	          (((globus_off_t)hdr[16] & 0xFF));
 
 	/* Mark us as read ready. */
 	dc->state = DC_STATE_READ_READY;
@@ -643,8 +869,145 @@ _f_eb_header_pullup(ebpd_t * ebpd, dc_t * dc)
 	return ec;
 }
 
+/* Time spent driving the channels is charged to MX_EB_POLL. */
 static errcode_t
 _f_eb_poll(dch_t * dch)
+{
+	errcode_t      ec = EC_SUCCESS;
+	struct timeval tv;
+
+	mx_now(&tv);
+	ec = _f_eb_poll_dcs(dch);
+	mx_add(MX_EB_POLL, &tv);
+	return ec;
+}
+
+/*
+ * Sleep until some channel can make progress rather than spinning on
+ * _f_eb_poll(). Returns immediately if a channel has work that does not
+ * need the network (buffered data, a queued push, authentication). Each
+ * channel's interest is kept in the reactor between calls so only state
+ * changes reach the kernel. If cc is set, a reply on the control channel
+ * also wakes us, as does the keepalive timer so the caller can send one.
+ * While the rate limit is exhausted, channels moving data wait on a timer
+ * for the refill instead of their sockets.
+ */
+static errcode_t
+_f_eb_wait(dch_t * dch, int cc)
+{
+	errcode_t ec   = EC_SUCCESS;
+	ebpd_t  * ebpd = (ebpd_t *) dch->privdata;
+	dc_t    * dc   = NULL;
+	int       want = 0;
+	int       cnt  = 0;
+	int       i    = 0;
+	int       rate = rl_wait(); /* Milliseconds until the bucket refills. */
+	int       held = 0;         /* Channels waiting on the bucket. */
+
+	for (i = 0; i < ebpd->dccnt; i++)
+	{
+		dc   = &ebpd->dcs[i];
+		want = 0;
+
+		switch (dc->state)
+		{
+		case DC_STATE_ACCEPT:
+			want = NET_POLL_READ;
+			break;
+
+		case DC_STATE_CONNECT:
+			want = NET_POLL_WRITE;
+			break;
+
+		case DC_STATE_READ_READY:
+			if (dc->buflen > 0)
+				return EC_SUCCESS;
+			if (dc->count == 0)
+			{
+				/* Waiting on _f_eb_read() to retire this channel. */
+				if (dc->eod)
+					break;
+				return EC_SUCCESS;
+			}
+			/* Fall through */
+		case DC_STATE_HEADER_PULLUP:
+			/* Nothing more is coming on this channel. */
+			if (dc->eof)
+				break;
+			/* Data already unwrapped or buffered by gsi. */
+			if (gsi_dc_ready(dc->gh, dc->nh, 1))
+				return EC_SUCCESS;
+			want = NET_POLL_READ;
+			break;
+
+		case DC_STATE_FLUSH_DATA:
+		case DC_STATE_FLUSH_EOF:
+		case DC_STATE_FLUSH_EOD:
+			want = NET_POLL_WRITE;
+			break;
+
+		case DC_STATE_READY:
+		case DC_STATE_EOD:
+			/* Zero copy completions wake the reactor; collect them. */
+			if (dc->gh)
+				gsi_dc_ready(dc->gh, dc->nh, 0);
+			break;
+
+		default:
+			/* Auth handshakes and pushes are driven by the next poll. */
+			return EC_SUCCESS;
+		}
+
+		if (want && rate > 0 &&
+		    dc->state != DC_STATE_ACCEPT && dc->state != DC_STATE_CONNECT)
+		{
+			want = 0;
+			held++;
+		}
+
+		ec = nr_watch(ebpd->nr, dc->nh, want);
+		if (ec)
+			return ec;
+
+		if (want)
+			cnt++;
+	}
+
+	/* Never sleep on nothing. */
+	if (!cnt && !held)
+		return EC_SUCCESS;
+
+	nr_timer(ebpd->nr, EB_TIMER_RATE, held ? rate : 0);
+
+	if (dch->cc)
+	{
+		ec = nr_watch(ebpd->nr, dch->cc, cc ? NET_POLL_READ : 0);
+		if (ec)
+			return ec;
+	}
+
+	/*
+	 * The timer stays armed across calls so a busy transfer that wakes
+	 * often still gets its keepalive on schedule.
+	 */
+	if (cc && s_keepalive() && !nr_armed(ebpd->nr, EB_TIMER_KEEPALIVE))
+		nr_timer(ebpd->nr, EB_TIMER_KEEPALIVE, s_keepalive() * 1000);
+
+	ec = nr_wait(ebpd->nr, EB_WAIT_MAX);
+
+	/* The caller checks the keepalive interval itself. */
+	nr_expired(ebpd->nr, EB_TIMER_KEEPALIVE);
+	nr_expired(ebpd->nr, EB_TIMER_RATE);
+
+	if (!ec && dch->intr)
+		ec = ec_create(EC_GSI_SUCCESS,
+		               EC_GSI_SUCCESS,
+		               "Transfer interrupted");
+	return ec;
+}
+
+static errcode_t
+_f_eb_poll_dcs(dch_t * dch)
 {
 	errcode_t ec   = EC_SUCCESS;
 	int       done = 0;
@@ -701,12 +1064,8 @@ _f_eb_poll(dch_t * dch)
 				ec = _f_eb_read_pullup(dc);
 			break;
 
-		case DC_STATE_PUSH_HEADER:
-			ec = _f_eb_push_header(ebpd, dc);
-			break;
-
-		case DC_STATE_PUSH_DATA:
-			ec = _f_eb_push_data(ebpd, dc);
+		case DC_STATE_PUSH_BLOCK:
+			ec = _f_eb_push_block(ebpd, dc);
 			break;
 
 		case DC_STATE_PUSH_EOD:
@@ -717,7 +1076,6 @@ _f_eb_poll(dch_t * dch)
 			ec = _f_eb_push_eof(ebpd, dc);
 			break;
 
-		case DC_STATE_FLUSH_HEADER:
 		case DC_STATE_FLUSH_DATA:
 		case DC_STATE_FLUSH_EOF:
 		case DC_STATE_FLUSH_EOD:
@@ -727,9 +1085,6 @@ _f_eb_poll(dch_t * dch)
 			{
 				switch (dc->state)
 				{
-				case DC_STATE_FLUSH_HEADER:
-					dc->state = DC_STATE_PUSH_DATA;
-					break;
 				case DC_STATE_FLUSH_DATA:
 				case DC_STATE_FLUSH_EOF:
 					dc->state = DC_STATE_READY;
@@ -749,7 +1104,7 @@ _f_eb_poll(dch_t * dch)
 static char *
 _f_eb_header(char desc, globus_off_t count, globus_off_t off)
 {
-	char * cptr = (char *) malloc(EB_HEADER_LEN);
+	char * cptr = pool_alloc(EB_HEADER_LEN);
 
 	cptr[0] = desc;
 
@@ -774,14 +1129,32 @@ _f_eb_header(char desc, globus_off_t count, globus_off_t off)
 	return cptr;
 }
 
+/* The header and its data leave together. */
 static errcode_t
-_f_eb_push_header(ebpd_t * ebpd, dc_t * dc)
+_f_eb_push_block(ebpd_t * ebpd, dc_t * dc)
 {
 	errcode_t  ec = EC_SUCCESS;
 	char * header = _f_eb_header(0, dc->count, dc->off);
 
-	ec = gsi_dc_write(dc->gh, dc->nh, header, EB_HEADER_LEN, 0);
-	dc->state = DC_STATE_FLUSH_HEADER;
+	ec = gsi_dc_writev(dc->gh,
+	                   dc->nh,
+	                   header,
+	                   EB_HEADER_LEN,
+	                   dc->buf,
+	                   dc->buflen,
+	                   0);
+	dc->buf    = NULL;
+	dc->buflen = 0;
+	dc->count  = 0;
+	dc->off    = 0;
+	dc->state  = DC_STATE_FLUSH_DATA;
+	if (ec)
+		return ec;
+
+	/* Most blocks fit in the socket buffer; skip a pass through poll. */
+	ec = gsi_dc_fl_write(dc->gh, dc->nh);
+	if (!ec && gsi_dc_ready(dc->gh, dc->nh, 0))
+		dc->state = DC_STATE_READY;
 	return ec;
 }
 
@@ -802,25 +1175,10 @@ static errcode_t
 _f_eb_push_eof(ebpd_t * ebpd, dc_t * dc)
 {
 	errcode_t  ec = EC_SUCCESS;
-	char * header = _f_eb_header(0x40, 0, s_parallel());
+	char * header = _f_eb_header(0x40, 0, ebpd->parallel);
 
 	ec = gsi_dc_write(dc->gh, dc->nh, header, EB_HEADER_LEN, 0);
 	dc->state = DC_STATE_FLUSH_EOF;
 	return ec;
 }
 
-static errcode_t
-_f_eb_push_data(ebpd_t * ebpd, dc_t * dc)
-{
-	errcode_t ec = EC_SUCCESS;
-
-	ec = gsi_dc_write(dc->gh, dc->nh, dc->buf, dc->buflen, 0);
-	dc->buf    = NULL;
-	dc->buflen = 0;
-	dc->count  = 0;
-	dc->off    = 0;
-	dc->state  = DC_STATE_FLUSH_DATA;
-
-	return ec;
-}
-
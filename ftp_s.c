@@ -40,6 +40,9 @@
  */
 
 #include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
 
 #include "settings.h"
 #include "errcode.h"
@@ -47,8 +50,10 @@
 #include "output.h"
 #include "ftp_s.h"
 #include "misc.h"
+#include "pool.h"
 #include "gsi.h"
 #include "ftp.h"
+#include "ratelimit.h"
 
 #ifdef DMALLOC
 #include "dmalloc.h"
@@ -118,7 +123,7 @@ _f_s_active(dch_t * dch, struct sockaddr_in * sin, int scnt)
 	memset(dc, 0, sizeof(dc_t));
 
 	/* Non blocking connect. */
-	ec = net_connect(&dc->nh, sin);
+	ec = net_connect(&dc->nh, sin, dch->tcpbuf);
 	if (ec)
 	{
 		FREE(dch->privdata);
@@ -140,7 +145,7 @@ _f_s_passive(dch_t * dch, struct sockaddr_in * sin)
 	dch->privdata = dc = (dc_t*) malloc(sizeof(dc_t));
 	memset(dc, 0, sizeof(dc_t));
 
-	ec = net_listen(&dc->nh, sin);
+	ec = net_listen(&dc->nh, sin, dch->tcpbuf);
 	if (ec)
 	{
 		FREE(dch->privdata);
@@ -164,8 +169,12 @@ _f_s_read_ready(dch_t * dch, int * ready)
 	if (ec || dc->state != DC_STATE_RD_WR)
 		return ec;
 
+	/* A single stream can wait out the rate limit right here. */
 	if (!gsi_dc_ready(dc->gh, dc->nh, 1))
+	{
+		rl_pause();
 		ec = gsi_dc_fl_read(dc->gh, dc->nh);
+	}
 	if (ec)
 		return ec;
 
@@ -193,6 +202,7 @@ _f_s_read(dch_t         * dch,
 
 	while (!ec && !gsi_dc_ready(dc->gh, dc->nh, 1))
 	{
+		rl_pause();
 		ec = gsi_dc_fl_read(dc->gh, dc->nh);
 	}
 	if (ec)
@@ -217,8 +227,12 @@ _f_s_write_ready(dch_t * dch, int * ready)
 	if (ec || dc->state != DC_STATE_RD_WR)
 		return ec;
 
+	/* A single stream can wait out the rate limit right here. */
 	if (!gsi_dc_ready(dc->gh, dc->nh, 0))
+	{
+		rl_pause();
 		ec = gsi_dc_fl_write(dc->gh, dc->nh);
+	}
 	if (ec)
 		return ec;
 
@@ -244,6 +258,7 @@ _f_s_write(dch_t * dch,
 
 	while (!ec && !gsi_dc_ready(dc->gh, dc->nh, 0))
 	{
+		rl_pause();
 		ec = gsi_dc_fl_write(dc->gh, dc->nh);
 	}
 
@@ -273,12 +288,108 @@ _f_s_close(dch_t * dch)
 		ec_destroy(ec);
 	}
 
+	gsi_dc_release(dc->gh, dc->nh);
 	net_destroy(dc->nh);
 	gsi_destroy(dc->gh);
 	FREE(dc);
 	dch->privdata = NULL;
 }
 
+#if defined(HAVE_SENDFILE) && defined(HAVE_SPLICE)
+/*
+ * Zero copy transfers. The caller only uses these when the channel carries
+ * clear data (no DCAU or PROT C) so the bytes on the wire are the bytes in
+ * the file.
+ */
+static errcode_t
+_f_s_sendfile(dch_t         * dch,
+              int             fd,
+              globus_off_t    off,
+              size_t        * len,
+              int           * eof)
+{
+	errcode_t ec    = EC_SUCCESS;
+	dc_t    * dc    = (dc_t*)dch->privdata;
+	size_t    taken = 0;
+
+	do {
+		ec = _f_s_poll(dch);
+	} while (!ec && dc->state != DC_STATE_RD_WR);
+
+	/* Anything written through _f_s_write() must go out first. */
+	while (!ec && !gsi_dc_ready(dc->gh, dc->nh, 0))
+	{
+		rl_pause();
+		ec = gsi_dc_fl_write(dc->gh, dc->nh);
+	}
+
+	if (ec)
+		return ec;
+
+	while (!(taken = rl_take(*len)) && *len)
+		rl_pause();
+	*len = taken;
+	ec = net_sendfile(dc->nh, fd, off, len, eof);
+	rl_return(taken - *len);
+	return ec;
+}
+
+static errcode_t
+_f_s_recvfile(dch_t         * dch,
+              int             fd,
+              globus_off_t  * off,
+              size_t        * len,
+              int           * eof)
+{
+	errcode_t ec  = EC_SUCCESS;
+	dc_t    * dc  = (dc_t*)dch->privdata;
+	char    * buf = NULL;
+	ssize_t   cnt = 0;
+	size_t    tot = 0;
+	size_t    taken = 0;
+
+	do {
+		ec = _f_s_poll(dch);
+	} while (!ec && dc->state != DC_STATE_RD_WR);
+
+	if (ec)
+		return ec;
+
+	*off = dc->off + dch->partial_off;
+
+	/* Bytes that arrived with the authentication are already buffered. */
+	if (gsi_dc_ready(dc->gh, dc->nh, 1))
+	{
+		ec = gsi_dc_read(dc->gh, dc->nh, &buf, len, eof);
+		if (ec)
+			return ec;
+
+		for (tot = 0; !ec && tot < *len; tot += cnt)
+		{
+			cnt = pwrite(fd, buf + tot, *len - tot, *off + tot);
+			if (cnt == -1 && errno == EINTR)
+				cnt = 0;
+			else if (cnt == -1)
+				ec = ec_create(EC_GSI_SUCCESS,
+				               EC_GSI_SUCCESS,
+				               "pwrite() failed: %s",
+				               strerror(errno));
+		}
+		pool_free(buf);
+	} else
+	{
+		while (!(taken = rl_take(*len)) && *len)
+			rl_pause();
+		*len = taken;
+		ec = net_splice_in(dc->nh, fd, *off, len, eof);
+		rl_return(taken - *len);
+	}
+
+	dc->off += *len;
+	return ec;
+}
+#endif /* HAVE_SENDFILE && HAVE_SPLICE */
+
 
 const dci_t Ftp_s_dci = {
 	_f_s_active,
@@ -288,5 +399,12 @@ const dci_t Ftp_s_dci = {
 	_f_s_write_ready,
 	_f_s_write,
 	_f_s_close,
+#if defined(HAVE_SENDFILE) && defined(HAVE_SPLICE)
+	_f_s_sendfile,
+	_f_s_recvfile,
+#else /* HAVE_SENDFILE && HAVE_SPLICE */
+	NULL, /* sendfile */
+	NULL, /* recvfile */
+#endif /* HAVE_SENDFILE && HAVE_SPLICE */
 };
 
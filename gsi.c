@@ -42,8 +42,12 @@
 /* System includes. */
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
 #include <gssapi.h>
 #include <netdb.h>
 
@@ -52,7 +56,10 @@
 #include "settings.h"
 #include "radix.h"
 #include "misc.h"
+#include "pool.h"
 #include "gsi.h"
+#include "metrics.h"
+#include "ratelimit.h"
 
 #ifdef DMALLOC
 #include "dmalloc.h"
@@ -69,8 +76,42 @@
 #define G_S_READ  0x00
 #define G_S_GEN   0x01
 #define G_S_WRITE 0x02
+
+/* How long closing a data channel waits for zero copy blocks (ms). */
+#define G_ZC_DRAIN 10000
+
+/*
+ * Drop the cached credential this many seconds before it expires so that a
+ * handshake never starts with a credential that runs out part way through.
+ */
+#define G_CRED_SLACK 60
+
+/*
+ * The user's credential. It is acquired once per process and shared by
+ * every control channel and DCAU handshake. The cache is dropped when the
+ * proxy file is replaced or the credential is about to expire; handles
+ * still using the old credential keep it until they are destroyed.
+ */
+typedef struct {
+	gss_cred_id_t cred;
+	int           refs; /* Handles using cred, plus one while cached. */
+} gc_t;
+
+static gc_t          * gcache   = NULL;
+static time_t          gexpires = 0; /* 0 if the credential never expires. */
+static struct stat     gproxy;       /* Proxy file when cred was acquired. */
+static pthread_mutex_t glock    = PTHREAD_MUTEX_INITIALIZER;
+
+/* A block sent zero copy that the kernel may still be reading. */
+typedef struct _g_zc_blk {
+	struct _g_zc_blk * next;
+	char             * buf;
+	unsigned int       id; /* Last send that used buf. */
+} zcb_t;
+
 struct _gsi_handle {
 	gss_cred_id_t creds;
+	gc_t        * gc;    /* Where creds came from. */
 	gss_ctx_id_t  cntxt;
 	gss_name_t    target;
 	int           success;
@@ -83,8 +124,16 @@ struct _gsi_handle {
 	int    len;
 	int    eof;
 	char * buf;
+	int    blk;  /* buf is a pool block. */
 	char * ubuf; /* For writing, the unwrapped buffer. */
 	int    ulen; /* For writing, the unwrapped length. */
+	char * hdr;  /* For writing in the clear, pool block sent before buf. */
+	size_t hlen;
+	size_t hcnt; /* Bytes of hdr left to send. */
+	int    zc;   /* buf (and hdr) are going out with MSG_ZEROCOPY. */
+	unsigned int zcid; /* Last zero copy send of buf. */
+	zcb_t * zhead; /* Blocks the kernel still holds, oldest first. */
+	zcb_t * ztail;
 
 	int    dcau; /* 0 no, 1 yes. */ /* Use s_dcau() for settings. */
 	int    pbsz; /* Protection buffer size */
@@ -105,17 +154,34 @@ _g_recv_token(gh_t * gh, nh_t * nh);
 errcode_t
 _g_acquire_cred(gss_cred_id_t * credp);
 
+static errcode_t
+_g_cred_get(gh_t * gh);
+
+static void
+_g_cred_put(gh_t * gh);
+
+static errcode_t
+_g_writev(gh_t * gh, nh_t * nh, struct iovec * iov, int iovcnt, size_t * count);
+
+static void
+_g_release(gh_t * gh, char * buf);
+
+static void
+_g_zc_reap(gh_t * gh, nh_t * nh);
+
+static void
+_g_release_unwrapped(char * buf);
+
 errcode_t
 gsi_init()
 {
-	OM_uint32     minor;
-	errcode_t     ec   = EC_SUCCESS;
-	gss_cred_id_t cred = GSS_C_NO_CREDENTIAL;
-
-	ec = _g_acquire_cred(&cred);
+	errcode_t ec = EC_SUCCESS;
+	gh_t      gh;
 
-	if (cred != GSS_C_NO_CREDENTIAL)
-		gss_release_cred(&minor, &cred);
+	/* Fill the cache now; we may not be able to read the files later. */
+	memset(&gh, 0, sizeof(gh_t));
+	ec = _g_cred_get(&gh);
+	_g_cred_put(&gh);
 
 	return ec;
 }
@@ -139,7 +205,7 @@ gsi_cc_init(gh_t ** ghp, char * host)
 	/*
 	 * Acquire the user's credentials.
 	 */
-	ec = _g_acquire_cred(&gh->creds);
+	ec = _g_cred_get(gh);
 	if (ec)
 		goto cleanup;
 
@@ -189,13 +255,29 @@ gsi_destroy(gh_t * gh)
 	if (gh->cntxt != GSS_C_NO_CONTEXT)
 		gss_delete_sec_context(&minor, &gh->cntxt, GSS_C_NO_BUFFER);
 
-	if (gh->creds != GSS_C_NO_CREDENTIAL)
-		gss_release_cred(&minor, &gh->creds);
+	_g_cred_put(gh);
 
 	if (gh->target != GSS_C_NO_NAME)
 		gss_release_name(&minor, &gh->target);
 
-	FREE(gh->buf);
+	if (gh->blk)
+		pool_free(gh->buf);
+	else
+		Free(gh->buf);
+	pool_free(gh->ubuf);
+	pool_free(gh->hdr);
+
+	/*
+	 * The kernel may still send from blocks gsi_dc_release() gave up on.
+	 * Leaking them is safer than letting the pool hand them out again.
+	 */
+	while (gh->zhead)
+	{
+		zcb_t * zcb = gh->zhead;
+		gh->zhead = zcb->next;
+		FREE(zcb);
+	}
+
 	FREE(gh);
 }
 
@@ -416,6 +498,7 @@ gsi_dc_fl_read(gh_t * gh, nh_t * nh)
 {
 	errcode_t ec = EC_SUCCESS;
 	size_t count = 0;
+	size_t taken = 0;
 
 	if (gh->eof)
 		return ec;
@@ -430,11 +513,16 @@ gsi_dc_fl_read(gh_t * gh, nh_t * nh)
 
 	if ((gh->len - gh->cnt) < s_blocksize())
 	{
-		gh->len += s_blocksize();
-		gh->buf = (char *) realloc(gh->buf, gh->len);
+		gh->buf = pool_realloc(gh->buf, gh->cnt + s_blocksize());
+		gh->len = pool_size(gh->buf);
+		gh->blk = 1;
 	}
 
-	count = gh->len-gh->cnt;
+	/* Nothing moves until the bucket refills. */
+	count = rl_take(gh->len-gh->cnt);
+	taken = count;
+	if (!count)
+		return ec;
 
 	ec = net_read(nh,
 	              gh->buf + gh->cnt,
@@ -444,6 +532,7 @@ gsi_dc_fl_read(gh_t * gh, nh_t * nh)
 	if (count > 0)
 		gh->cnt += count;
 
+	rl_return(taken - count);
 	return ec;
 }
 
@@ -458,6 +547,8 @@ gsi_dc_fl_write(gh_t * gh, nh_t * nh)
 	OM_uint32 major;
 	OM_uint32 minor;
 	int       cstate = 0;
+	struct timeval tv;
+	struct iovec   iov[2];
 
 
     do {
@@ -470,6 +561,7 @@ gsi_dc_fl_write(gh_t * gh, nh_t * nh)
 			if (gh->ulen > gh->upbsz)
 				uwbuf.length = gh->upbsz;
 
+			mx_now(&tv);
 			major = gss_wrap(&minor,
 			                 gh->cntxt,
 			                 s_prot() == 3,
@@ -477,6 +569,7 @@ gsi_dc_fl_write(gh_t * gh, nh_t * nh)
 			                &uwbuf,
 			                &cstate,
 			                &wbuf);
+			mx_add(MX_GSS_WRAP, &tv);
 
 			if (major != GSS_S_COMPLETE)
 				return ec_create(major,
@@ -488,7 +581,7 @@ gsi_dc_fl_write(gh_t * gh, nh_t * nh)
 
 			if (gh->ulen == 0)
 			{
-				FREE(gh->ubuf);
+				pool_free(gh->ubuf);
 				gh->ubuf = 0;
 			}
 
@@ -502,9 +595,34 @@ gsi_dc_fl_write(gh_t * gh, nh_t * nh)
             off = gh->len - gh->cnt;
             count = gh->cnt;
 
-            ec = net_write_nb(nh,
-                              gh->buf+off,
-                             &count);
+			if (gh->hcnt)
+			{
+				iov[0].iov_base = gh->hdr + (gh->hlen - gh->hcnt);
+				iov[0].iov_len  = gh->hcnt;
+				iov[1].iov_base = gh->buf + off;
+				iov[1].iov_len  = gh->cnt;
+				count = gh->hcnt + gh->cnt;
+
+				ec = _g_writev(gh, nh, iov, 2, &count);
+
+				/* Split what is left between the header and the data. */
+				if (ec == EC_SUCCESS && count > gh->cnt)
+				{
+					gh->hcnt = count - gh->cnt;
+					count    = gh->cnt;
+				} else if (ec == EC_SUCCESS)
+				{
+					gh->hcnt = 0;
+					_g_release(gh, gh->hdr);
+					gh->hdr  = NULL;
+				}
+			} else
+			{
+				iov[0].iov_base = gh->buf + off;
+				iov[0].iov_len  = gh->cnt;
+
+				ec = _g_writev(gh, nh, iov, 1, &count);
+			}
 
             if (ec == EC_SUCCESS)
             {
@@ -513,8 +631,13 @@ gsi_dc_fl_write(gh_t * gh, nh_t * nh)
                 {
                     gh->cnt = 0;
                     gh->len = 0;
-                    FREE(gh->buf);
+                    if (gh->blk)
+                        _g_release(gh, gh->buf);
+                    else
+                        Free(gh->buf);
                     gh->buf = NULL;
+                    gh->blk = 0;
+                    gh->zc  = 0;
                 }
             }
         }
@@ -537,25 +660,33 @@ gsi_dc_read(gh_t   *  gh,
 	OM_uint32 minor;
 	gss_buffer_desc wbuf;
 	gss_buffer_desc uwbuf;
+	struct timeval  tv;
 
 	if (gh->dcau && s_prot() && gh->cnt)
 	{
 		wbuf.value  = gh->buf;
 		wbuf.length = SSL_TOK_LEN(gh->buf) + 5;
+		mx_now(&tv);
 		major = gss_unwrap(&minor,
 		                    gh->cntxt,
 		                   &wbuf,
 		                   &uwbuf,
 		                   &cstate,
 		                   &qstate);
+		mx_add(MX_GSS_UNWRAP, &tv);
 
 		if (major != GSS_S_COMPLETE)
 			return ec_create(major,
 			                 minor,
 			                 "Failed to unwrap buffer");
 
-		*buf = (char *)uwbuf.value;
+		/* Pass the unwrapped token up as is; see _g_release_unwrapped(). */
+		*buf = NULL;
 		*len = uwbuf.length;
+		if (uwbuf.value)
+			*buf = pool_adopt((char *)uwbuf.value,
+			                  uwbuf.length,
+			                  _g_release_unwrapped);
 		
 		gh->cnt -= SSL_TOK_LEN(gh->buf) + 5;
 		memmove(gh->buf, 
@@ -572,6 +703,7 @@ gsi_dc_read(gh_t   *  gh,
 	*eof = gh->eof;
 
 	gh->buf = NULL;
+	gh->blk = 0;
 	gh->cnt = 0;
 	gh->len = 0;
 
@@ -597,8 +729,12 @@ gsi_dc_write(gh_t  * gh,
 	else
 	{
     	gh->buf  = buf;
+   		gh->blk  = 1;
    		gh->cnt  = len;
    		gh->len  = len;
+
+		/* Large clear blocks skip the copy into the socket. */
+		gh->zc = s_zerocopy() && len >= s_zerocopy() && net_zc_enable(nh);
 	}
 
     if (eof)
@@ -607,6 +743,35 @@ gsi_dc_write(gh_t  * gh,
     return EC_SUCCESS;
 }
 
+errcode_t
+gsi_dc_writev(gh_t  * gh,
+              nh_t  * nh,
+              char  * hdr,
+              size_t  hlen,
+              char  * buf,
+              size_t  len,
+              int     eof)
+{
+	char * ubuf = NULL;
+
+	if (!gh->dcau || !s_prot())
+	{
+		gh->hdr  = hdr;
+		gh->hlen = hlen;
+		gh->hcnt = hlen;
+		return gsi_dc_write(gh, nh, buf, len, eof);
+	}
+
+	/* One token for both. gss_wrap() copies the data regardless. */
+	ubuf = pool_alloc(hlen + len);
+	memcpy(ubuf, hdr, hlen);
+	memcpy(ubuf + hlen, buf, len);
+	pool_free(hdr);
+	pool_free(buf);
+
+	return gsi_dc_write(gh, nh, ubuf, hlen + len, eof);
+}
+
 
 int
 gsi_dc_ready(gh_t * gh, nh_t * nh, int read)
@@ -623,12 +788,127 @@ gsi_dc_ready(gh_t * gh, nh_t * nh, int read)
 			return 1;
 	}
 
+	if (!read && gh->zhead)
+		_g_zc_reap(gh, nh);
+
 	if (!read && !gh->buf && !gh->ubuf && !gh->eof)
 		return 1;
 
 	return 0;
 }
 
+void
+gsi_dc_release(gh_t * gh, nh_t * nh)
+{
+	if (!gh || !gh->ztail)
+		return;
+
+	/* Sends complete in order, so the newest covers them all. */
+	net_zc_done(nh, gh->ztail->id, G_ZC_DRAIN);
+	_g_zc_reap(gh, nh);
+}
+
+/* Send iov, from the caller's pages if the block was set up for it. */
+static errcode_t
+_g_writev(gh_t * gh, nh_t * nh, struct iovec * iov, int iovcnt, size_t * count)
+{
+	errcode_t    ec    = EC_SUCCESS;
+	size_t       total = *count;
+	size_t       left  = 0;
+	size_t       taken = 0;
+	unsigned int id    = 0;
+	int          i     = 0;
+	struct iovec liov[2];
+
+	/*
+	 * Send no more than the rate limit allows right now. Only the final
+	 * flush, which loops here until it is done, waits for the bucket.
+	 */
+	while (!(taken = rl_take(total)) && total && gh->eof)
+		rl_pause();
+	if (!taken)
+		return EC_SUCCESS;
+
+	left = taken;
+	for (i = 0; i < iovcnt && i < 2; i++)
+	{
+		liov[i] = iov[i];
+		if (liov[i].iov_len > left)
+			liov[i].iov_len = left;
+		left -= liov[i].iov_len;
+	}
+	left = taken;
+
+	if (!gh->zc)
+	{
+		ec = net_writev_nb(nh, liov, i, &left);
+	} else
+	{
+		/* A send that fell back to copying is not numbered. */
+		id = gh->zcid;
+		ec = net_write_zc(nh, liov, i, &left, &id);
+		if (ec == EC_SUCCESS)
+			gh->zcid = id;
+	}
+
+	rl_return(left);
+	*count = total - (taken - left);
+	return ec;
+}
+
+/* Return a sent block to the pool once the kernel is done with it. */
+static void
+_g_release(gh_t * gh, char * buf)
+{
+	zcb_t * zcb = NULL;
+
+	if (!gh->zc)
+	{
+		pool_free(buf);
+		return;
+	}
+
+	zcb = (zcb_t *) malloc(sizeof(zcb_t));
+	zcb->next = NULL;
+	zcb->buf  = buf;
+	zcb->id   = gh->zcid;
+
+	if (gh->ztail)
+		gh->ztail->next = zcb;
+	else
+		gh->zhead = zcb;
+	gh->ztail = zcb;
+}
+
+/* pool_free() of a buffer returned by gss_unwrap() in gsi_dc_read(). */
+static void
+_g_release_unwrapped(char * buf)
+{
+	OM_uint32       minor;
+	gss_buffer_desc uwbuf;
+
+	uwbuf.value  = buf;
+	uwbuf.length = 0;
+	gss_release_buffer(&minor, &uwbuf);
+}
+
+static void
+_g_zc_reap(gh_t * gh, nh_t * nh)
+{
+	zcb_t * zcb = NULL;
+
+	while (gh->zhead && net_zc_done(nh, gh->zhead->id, 0))
+	{
+		zcb = gh->zhead;
+		gh->zhead = zcb->next;
+		if (!gh->zhead)
+			gh->ztail = NULL;
+
+		pool_free(zcb->buf);
+		FREE(zcb);
+	}
+}
+
 /* Finds max encoded msg size for given buffer length. */
 errcode_t
 gsi_pbsz_maxpmsg(gh_t * gh, int umsglen, int * pmsglen)
@@ -782,7 +1062,7 @@ _g_gen_token(gh_t * gh, int init)
 
 	if (gh->creds == GSS_C_NO_CREDENTIAL)
 	{
-		ec = _g_acquire_cred(&gh->creds);
+		ec = _g_cred_get(gh);
 		if (ec)
 			return ec;
 
@@ -993,26 +1273,15 @@ _g_acquire_cred(gss_cred_id_t * credp)
 {
 	OM_uint32       major;
 	OM_uint32       minor;
+#ifdef MSSFTP
+	OM_uint32       imajor;
 	static gss_buffer_desc exported_creds = {0, NULL};
+#endif /* MSSFTP */
 #if defined MSSFTP && defined MSSFTP_GSI_SERVICE
 	gss_buffer_desc input_name_buffer;
 	gss_name_t      target;
 #endif /* MSSFTP && MSSFTP_GSI_SERVICE */
 
-	if (exported_creds.length)
-	{
-		major = gss_import_cred (&minor,
-		                          credp,
-		                          NULL,
-		                          0,
-		                         &exported_creds,
-		                          0,
-		                          0);
-
-		if (major == GSS_S_COMPLETE)
-			return EC_SUCCESS;
-	}
-
 #ifdef MSSFTP
 #ifdef MSSFTP_GSI_SERVICE
 XXX Fix for local hostname
@@ -1055,11 +1324,32 @@ XXX Fix for local hostname
 			                  NULL,
 			                  NULL);
 
+#ifdef MSSFTP
+	/*
+	 * Once we have given up our privileges, the service credential can
+	 * not be read again. Fall back to the copy saved by gsi_init().
+	 */
+	if (major != GSS_S_COMPLETE && exported_creds.length)
+	{
+		imajor = gss_import_cred (&minor,
+		                           credp,
+		                           NULL,
+		                           0,
+		                          &exported_creds,
+		                           0,
+		                           0);
+
+		if (imajor == GSS_S_COMPLETE)
+			return EC_SUCCESS;
+	}
+#endif /* MSSFTP */
+
 	if (major != GSS_S_COMPLETE)
 		return ec_create(major, 
 		                 minor,
 		                 "Failed to acquire credentials.");
 
+#ifdef MSSFTP
 	if (exported_creds.length)
 		gss_release_buffer(&minor, &exported_creds);
 	exported_creds.length = 0;
@@ -1069,6 +1359,110 @@ XXX Fix for local hostname
 	                         NULL,
 	                         0,
 	                        &exported_creds);
+#endif /* MSSFTP */
 
 	return EC_SUCCESS;
 }
+
+/* Where the GSI libraries look for the user's proxy. */
+static void
+_g_proxy_stat(struct stat * st)
+{
+	char * path = getenv("X509_USER_PROXY");
+	char   buf[64];
+
+	if (!path)
+	{
+		snprintf(buf, sizeof(buf), "/tmp/x509up_u%d", (int) getuid());
+		path = buf;
+	}
+
+	if (stat(path, st))
+		memset(st, 0, sizeof(struct stat));
+}
+
+/* Must the cached credential be acquired again? */
+static int
+_g_cred_stale(void)
+{
+	struct stat st;
+
+	if (!gcache)
+		return 1;
+
+	if (gexpires && time(NULL) + G_CRED_SLACK >= gexpires)
+		return 1;
+
+	_g_proxy_stat(&st);
+	return st.st_ino   != gproxy.st_ino  ||
+	       st.st_size  != gproxy.st_size ||
+	       st.st_mtime != gproxy.st_mtime;
+}
+
+/* Hand the process' credential to gh, acquiring it if need be. */
+static errcode_t
+_g_cred_get(gh_t * gh)
+{
+	errcode_t     ec       = EC_SUCCESS;
+	OM_uint32     major;
+	OM_uint32     minor;
+	OM_uint32     lifetime = 0;
+	gss_cred_id_t cred     = GSS_C_NO_CREDENTIAL;
+	gc_t        * gc       = NULL;
+
+	pthread_mutex_lock(&glock);
+
+	if (_g_cred_stale())
+	{
+		/* Look at the proxy before reading it so a racing update is seen. */
+		_g_proxy_stat(&gproxy);
+
+		ec = _g_acquire_cred(&cred);
+		if (ec)
+			goto finish;
+
+		gexpires = 0;
+		major = gss_inquire_cred(&minor, cred, NULL, &lifetime, NULL, NULL);
+		if (major == GSS_S_COMPLETE && lifetime != GSS_C_INDEFINITE)
+			gexpires = time(NULL) + lifetime;
+
+		if (gcache && --gcache->refs == 0)
+		{
+			gss_release_cred(&minor, &gcache->cred);
+			FREE(gcache);
+		}
+
+		gc = (gc_t *) malloc(sizeof(gc_t));
+		gc->cred = cred;
+		gc->refs = 1;
+		gcache   = gc;
+	}
+
+	gcache->refs++;
+	gh->gc    = gcache;
+	gh->creds = gcache->cred;
+
+finish:
+	pthread_mutex_unlock(&glock);
+	return ec;
+}
+
+static void
+_g_cred_put(gh_t * gh)
+{
+	OM_uint32 minor;
+
+	if (!gh->gc)
+		return;
+
+	pthread_mutex_lock(&glock);
+	if (--gh->gc->refs == 0)
+	{
+		gss_release_cred(&minor, &gh->gc->cred);
+		FREE(gh->gc);
+	}
+	pthread_mutex_unlock(&glock);
+
+	gh->gc    = NULL;
+	gh->creds = GSS_C_NO_CREDENTIAL;
+}
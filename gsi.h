@@ -87,9 +87,33 @@ gsi_dc_write(gh_t  * gh,
              size_t  len,
              int     eof);
 
+/*
+ * Same as gsi_dc_write() but hdr (a pool block of hlen bytes) goes out
+ * ahead of buf. In the clear both leave in one writev(); when the channel
+ * is protected they are wrapped together.
+ */
+errcode_t
+gsi_dc_writev(gh_t  * gh,
+              nh_t  * nh,
+              char  * hdr,
+              size_t  hlen,
+              char  * buf,
+              size_t  len,
+              int     eof);
+
 int
 gsi_dc_ready(gh_t * gh, nh_t * nh, int read);
 
+/*
+ * Blocks at least s_zerocopy() bytes long are sent with MSG_ZEROCOPY when
+ * the channel is in the clear, so they stay in use after gsi_dc_write()
+ * has sent them. They return to the pool as the kernel releases them
+ * (checked by gsi_dc_ready()). Call this before closing nh to wait for the
+ * rest; any the kernel still holds are never reused.
+ */
+void
+gsi_dc_release(gh_t * gh, nh_t * nh);
+
 errcode_t
 gsi_pbsz_maxpmsg(gh_t * gh, int umsglen, int * pmsglen);
 
@@ -0,0 +1,396 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include <globus_common.h>
+
+#include "settings.h"
+#include "journal.h"
+#include "output.h"
+#include "misc.h"
+
+#ifdef DMALLOC
+#include "dmalloc.h"
+#endif /* DMALLOC */
+
+#define JN_MAGIC      "# uberftp journal 1\n"
+#define JN_SYNC_COUNT 64 /* Records between fsync()s... */
+#define JN_SYNC_SECS  2  /* ...or seconds, whichever comes first. */
+
+/*
+ * Each record is one line:
+ *
+ *   <size|-> <crc|-> <src>\t<dst>\n
+ *
+ * The key is everything after the second space.
+ */
+typedef struct _jne {
+	struct _jne        * next;
+	unsigned long long   hash;
+	char               * key;
+} jne_t;
+
+static struct {
+	char         * path;     /* Journal in use, NULL if none. */
+	int            fd;       /* -1 if path could not be opened. */
+	jne_t       ** buckets;
+	int            nbuckets;
+	int            cnt;
+	int            unsynced;
+	time_t         synced;
+	int            hooked;   /* jn_sync() registered with atexit(). */
+
+	/* Noted by jn_xfer(). */
+	globus_off_t   size;
+	unsigned int   crc;
+	int            hascrc;
+	int            noted;
+} jn = { NULL, -1 };
+
+static jne_t *
+_jn_find(char * key, size_t len, unsigned long long hash)
+{
+	jne_t * je = NULL;
+
+	if (!jn.nbuckets)
+		return NULL;
+
+	for (je = jn.buckets[hash % jn.nbuckets]; je; je = je->next)
+	{
+		if (je->hash == hash && 
+		    strncmp(je->key, key, len) == 0 && je->key[len] == '\0')
+			return je;
+	}
+	return NULL;
+}
+
+static void
+_jn_insert(char * key, size_t len)
+{
+	unsigned long long   hash     = Fnv1a(FNV1A_BASIS, key, len);
+	jne_t             ** buckets  = NULL;
+	jne_t              * je       = NULL;
+	int                  nbuckets = 0;
+	int                  i        = 0;
+
+	if (_jn_find(key, len, hash))
+		return;
+
+	/* Keep the chains short. */
+	if (jn.cnt >= jn.nbuckets * 2)
+	{
+		nbuckets = jn.nbuckets ? jn.nbuckets * 4 : 1024;
+		buckets  = (jne_t **) malloc(sizeof(jne_t *) * nbuckets);
+		memset(buckets, 0, sizeof(jne_t *) * nbuckets);
+
+		for (i = 0; i < jn.nbuckets; i++)
+		{
+			while ((je = jn.buckets[i]))
+			{
+				jn.buckets[i] = je->next;
+				je->next = buckets[je->hash % nbuckets];
+				buckets[je->hash % nbuckets] = je;
+			}
+		}
+
+		FREE(jn.buckets);
+		jn.buckets  = buckets;
+		jn.nbuckets = nbuckets;
+	}
+
+	je = (jne_t *) malloc(sizeof(jne_t));
+	je->hash = hash;
+	je->key  = Strndup(key, len);
+	je->next = jn.buckets[hash % jn.nbuckets];
+	jn.buckets[hash % jn.nbuckets] = je;
+	jn.cnt++;
+}
+
+static void
+_jn_close(void)
+{
+	int     i  = 0;
+	jne_t * je = NULL;
+
+	jn_sync();
+
+	if (jn.fd != -1)
+		close(jn.fd);
+	jn.fd = -1;
+
+	for (i = 0; i < jn.nbuckets; i++)
+	{
+		while ((je = jn.buckets[i]))
+		{
+			jn.buckets[i] = je->next;
+			FREE(je->key);
+			FREE(je);
+		}
+	}
+
+	FREE(jn.buckets);
+	FREE(jn.path);
+	jn.nbuckets = 0;
+	jn.cnt      = 0;
+}
+
+/* Index every record in the journal. */
+static void
+_jn_load(void)
+{
+	char    * buf  = NULL;
+	char    * line = NULL;
+	char    * nl   = NULL;
+	char    * key  = NULL;
+	off_t     len  = 0;
+	off_t     end  = 0;
+	ssize_t   cnt  = 0;
+	struct stat st;
+
+	if (fstat(jn.fd, &st) || st.st_size == 0)
+	{
+		if (write(jn.fd, JN_MAGIC, strlen(JN_MAGIC)) == -1)
+			o_fprintf(stderr,
+			          DEBUG_ERRS_ONLY,
+			          "Failed to write to the journal %s: %s\n",
+			          jn.path,
+			          strerror(errno));
+		return;
+	}
+
+	buf = (char *) malloc(st.st_size + 1);
+	while (len < st.st_size)
+	{
+		cnt = pread(jn.fd, buf + len, st.st_size - len, len);
+		if (cnt == -1 && errno == EINTR)
+			continue;
+		if (cnt <= 0)
+			break;
+		len += cnt;
+	}
+	buf[len] = '\0';
+
+	for (line = buf; (nl = strchr(line, '\n')); line = nl + 1)
+	{
+		end = nl + 1 - buf;
+		if (*line == '#')
+			continue;
+
+		/* Skip the size and the checksum. */
+		key = strchr(line, ' ');
+		if (key && key < nl)
+			key = strchr(key + 1, ' ');
+		if (!key || key > nl)
+			continue;
+
+		key++;
+		_jn_insert(key, nl - key);
+	}
+
+	/* Drop a record that was cut short so the next one starts clean. */
+	if (end < len)
+	{
+		o_fprintf(stderr,
+		          DEBUG_NORMAL,
+		          "Discarding a partial record at the end of %s\n",
+		          jn.path);
+		if (ftruncate(jn.fd, end))
+			o_fprintf(stderr,
+			          DEBUG_ERRS_ONLY,
+			          "Failed to truncate the journal %s: %s\n",
+			          jn.path,
+			          strerror(errno));
+	}
+
+	FREE(buf);
+}
+
+/* Make sure the journal setting is loaded. Returns 0 if there is none. */
+static int
+_jn_ready(void)
+{
+	if (!s_journal())
+	{
+		if (jn.path)
+			_jn_close();
+		return 0;
+	}
+
+	if (jn.path && strcmp(jn.path, s_journal()) == 0)
+		return jn.fd != -1;
+
+	_jn_close();
+
+	jn.path   = Strdup(s_journal());
+	jn.synced = time(NULL);
+	jn.fd     = open(jn.path, O_RDWR|O_APPEND|O_CREAT, S_IRUSR|S_IWUSR);
+	if (jn.fd == -1)
+	{
+		o_fprintf(stderr,
+		          DEBUG_ERRS_ONLY,
+		          "Failed to open the journal %s: %s\n",
+		          jn.path,
+		          strerror(errno));
+		return 0;
+	}
+
+	if (!jn.hooked)
+		jn.hooked = !atexit(jn_sync);
+
+	_jn_load();
+	return 1;
+}
+
+/* Tabs and newlines would break the record format. */
+static char *
+_jn_key(char * src, char * dst)
+{
+	if (strpbrk(src, "\t\n") || strpbrk(dst, "\t\n"))
+		return NULL;
+	return Sprintf(NULL, "%s\t%s", src, dst);
+}
+
+void
+jn_load(void)
+{
+	_jn_ready();
+}
+
+int
+jn_done(char * src, char * dst)
+{
+	char * key  = NULL;
+	size_t len  = 0;
+	int    done = 0;
+
+	if (!_jn_ready())
+		return 0;
+
+	key = _jn_key(src, dst);
+	if (!key)
+		return 0;
+
+	len  = strlen(key);
+	done = _jn_find(key, len, Fnv1a(FNV1A_BASIS, key, len)) != NULL;
+	FREE(key);
+	return done;
+}
+
+void
+jn_xfer(globus_off_t size, unsigned int crc, int hascrc)
+{
+	jn.size   = size;
+	jn.crc    = crc;
+	jn.hascrc = hascrc;
+	jn.noted  = 1;
+}
+
+void
+jn_add(char * src, char * dst)
+{
+	char    * key  = NULL;
+	char    * rec  = NULL;
+	char      size[32];
+	char      crc[16];
+	size_t    len  = 0;
+	ssize_t   cnt  = 0;
+
+	if (!_jn_ready())
+		goto finish;
+
+	key = _jn_key(src, dst);
+	if (!key)
+		goto finish;
+
+	strcpy(size, "-");
+	if (jn.noted && jn.size != (globus_off_t)-1)
+		snprintf(size, sizeof(size), "%"GLOBUS_OFF_T_FORMAT, jn.size);
+
+	strcpy(crc, "-");
+	if (jn.noted && jn.hascrc)
+		snprintf(crc, sizeof(crc), "%08x", jn.crc);
+
+	rec = Sprintf(NULL, "%s %s %s\n", size, crc, key);
+	len = strlen(rec);
+
+	/* One write per record keeps records whole between processes. */
+	do {
+		cnt = write(jn.fd, rec, len);
+	} while (cnt == -1 && errno == EINTR);
+
+	if (cnt != (ssize_t) len)
+	{
+		o_fprintf(stderr,
+		          DEBUG_ERRS_ONLY,
+		          "Failed to write to the journal %s: %s\n",
+		          jn.path,
+		          cnt == -1 ? strerror(errno) : "short write");
+		goto finish;
+	}
+
+	_jn_insert(key, strlen(key));
+
+	if (++jn.unsynced >= JN_SYNC_COUNT || time(NULL) - jn.synced >= JN_SYNC_SECS)
+		jn_sync();
+
+finish:
+	jn.noted = 0;
+	FREE(key);
+	FREE(rec);
+}
+
+void
+jn_sync(void)
+{
+	if (jn.fd == -1 || !jn.unsynced)
+		return;
+
+	fsync(jn.fd);
+	jn.unsynced = 0;
+	jn.synced   = time(NULL);
+}
@@ -0,0 +1,80 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef UBER_JOURNAL_H
+#define UBER_JOURNAL_H
+
+#include <globus_common.h>
+
+/*
+ * Checkpoint journal for bulk transfers. When the journal setting names a
+ * file, every url file entry and every file moved by a recursive or
+ * multiple file transfer is appended to it once it completes, with its size
+ * and checksum (if cksum verified one). The journal is indexed by a hash
+ * table when it is first used, so a restarted job skips each completed
+ * entry without touching the network. Records are fsync()ed in batches;
+ * after a crash, at most the last batch is transferred again.
+ *
+ * Records are single O_APPEND writes, so the forked transfer workers can
+ * share the journal with their parent.
+ */
+
+/*
+ * Load the journal now, before forking workers, so that they share the
+ * parent's index instead of each reading the journal.
+ */
+void jn_load(void);
+
+/* Has src -> dst completed? */
+int jn_done(char * src, char * dst);
+
+/*
+ * Note the size and, if hascrc is set, the checksum of the file that just
+ * completed. The next jn_add() records them.
+ */
+void jn_xfer(globus_off_t size, unsigned int crc, int hascrc);
+
+/* Record that src -> dst completed. */
+void jn_add(char * src, char * dst);
+
+/* Flush records to disk. */
+void jn_sync(void);
+
+#endif /* UBER_JOURNAL_H */
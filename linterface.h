@@ -108,6 +108,22 @@ typedef struct logical_interface {
 	errcode_t (*utime)(pd_t *, char * path, time_t timestamp);
 	errcode_t (*lscos) (pd_t *, char **);
 	errcode_t (*lsfam) (pd_t *, char **);
+	void      (*detach)(pd_t *);
+	int       (*fileno)(pd_t *);
+	int       (*zcopy)(pd_t *);
+	errcode_t (*sendfile)(pd_t *,
+	                      int             fd,
+	                      globus_off_t    off,
+	                      size_t        * len,
+	                      int           * eof);
+	errcode_t (*recvfile)(pd_t *,
+	                      int             fd,
+	                      globus_off_t  * off,
+	                      size_t        * len,
+	                      int           * eof);
+	char *    (*url)(pd_t *, char * path);
+	int       (*lost)(pd_t *);
+	void      (*interrupt)(pd_t *);
 #ifdef SYSLOG_PERF
 	char *    (*rhost) (pd_t *);
 #endif /* SYSLOG_PERF */
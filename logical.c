@@ -43,6 +43,7 @@
 #include <time.h>
 
 #include "linterface.h"
+#include "settings.h"
 #include "logical.h"
 #include "unix.h"
 #include "ftp.h"
@@ -320,6 +321,94 @@ l_lsfam(lh_t lh, char ** families)
 	return lh->li.lsfam(&lh->privdata, families);
 }
 
+void
+l_detach(lh_t lh)
+{
+	if (lh->li.detach)
+		lh->li.detach(&lh->privdata);
+}
+
+int
+l_zcopy_ok(lh_t slh, lh_t dlh)
+{
+	if (slh->li.fileno && dlh->li.zcopy && dlh->li.sendfile &&
+	    slh->li.fileno(&slh->privdata) != -1 &&
+	    dlh->li.zcopy(&dlh->privdata))
+		return 1;
+
+	if (dlh->li.fileno && slh->li.zcopy && slh->li.recvfile &&
+	    dlh->li.fileno(&dlh->privdata) != -1 &&
+	    slh->li.zcopy(&slh->privdata))
+		return 1;
+
+	return 0;
+}
+
+errcode_t
+l_zcopy(lh_t            slh,
+        lh_t            dlh,
+        globus_off_t  * off,
+        globus_off_t  * left,
+        size_t        * len,
+        int           * eof)
+{
+	int       fd = -1;
+	errcode_t ec = EC_SUCCESS;
+
+	*len = s_blocksize();
+	*eof = 0;
+
+	if (slh->li.fileno)
+		fd = slh->li.fileno(&slh->privdata);
+
+	/* Receiving into a local file. */
+	if (fd == -1)
+	{
+		fd = dlh->li.fileno(&dlh->privdata);
+		ec = slh->li.recvfile(&slh->privdata, fd, off, len, eof);
+		if (!ec)
+			*off += *len;
+		return ec;
+	}
+
+	/* Sending from a local file. */
+	if ((globus_off_t)*len > *left)
+		*len = *left;
+
+	ec = dlh->li.sendfile(&dlh->privdata, fd, *off, len, eof);
+	if (ec)
+		return ec;
+
+	*off  += *len;
+	*left -= *len;
+	if (*left == 0)
+		*eof = 1;
+	return ec;
+}
+
+char *
+l_url(lh_t lh, char * path)
+{
+	if (!lh->li.url)
+		return NULL;
+	return lh->li.url(&lh->privdata, path);
+}
+
+int
+l_lost(lh_t lh)
+{
+	if (!lh->li.lost)
+		return 0;
+	return lh->li.lost(&lh->privdata);
+}
+
+void
+l_interrupt(lh_t lh)
+{
+	if (lh->li.interrupt)
+		lh->li.interrupt(&lh->privdata);
+}
+
 #ifdef SYSLOG_PERF
 char *
 l_rhost (lh_t lh)
@@ -110,6 +110,47 @@ errcode_t l_symlink(lh_t, char * oldfile, char * newfile);
 errcode_t l_utime(lh_t, char * path, time_t timestamp);
 errcode_t l_lscos(lh_t, char **);
 errcode_t l_lsfam(lh_t, char **);
+
+/*
+ * Drop this process' copy of the session without ending it. Used by forked
+ * workers; the service reconnects on its next command.
+ */
+void l_detach(lh_t);
+
+/*
+ * Returns 1 if the data between slh and dlh can be moved by the kernel:
+ * one side is a plain local file and the other is a stream mode data
+ * channel carrying clear data. Call after l_storfile() and l_retrvfile().
+ */
+int l_zcopy_ok(lh_t slh, lh_t dlh);
+
+/*
+ * Move the next block when l_zcopy_ok() is true. len is set to the bytes
+ * moved and off is left just past them. When sending, off and left track
+ * the source file's position and remaining length.
+ */
+errcode_t l_zcopy(lh_t            slh,
+                  lh_t            dlh,
+                  globus_off_t  * off,
+                  globus_off_t  * left,
+                  size_t        * len,
+                  int           * eof);
+
+/*
+ * Returns a URL naming the absolute path on this session's server, or NULL
+ * if the service has none. The caller frees it.
+ */
+char * l_url(lh_t lh, char * path);
+
+/* 1 if the session's control connection has dropped since it opened. */
+int l_lost(lh_t lh);
+
+/*
+ * Make a read that another thread has blocked in lh give up with an error.
+ * Only sets a flag, so it is safe to call while that read runs.
+ */
+void l_interrupt(lh_t lh);
+
 #ifdef SYSLOG_PERF
 char * l_rhost(lh_t);
 #endif /* SYSLOG_PERF */
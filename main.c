@@ -38,6 +38,7 @@
  * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
  * DEALINGS WITH THE SOFTWARE.
  */
+#include <sys/stat.h>
 #include <ctype.h>
 #include <stdio.h>
 #include <string.h>
@@ -57,6 +58,10 @@
 #include "misc.h"
 #include "cmds.h"
 #include "gsi.h"
+#include "ratelimit.h"
+#include "plan.h"
+#include "journal.h"
+#include "worker.h"
 
 #ifdef DMALLOC
 #include "dmalloc.h"
@@ -110,6 +115,41 @@ static cmdret_t _m_open(char * cmd,
                         char * user, 
                         char * pass);
 
+#ifndef MSSFTP
+/*
+ * An open URL mode session. Consecutive url file entries that name the
+ * same endpoint reuse the session instead of reconnecting.
+ */
+typedef struct {
+	char * open;  /* Command that opens the session. */
+	char * close; /* Command that closes the session. */
+	char * host;  /* NULL if the session is not open. */
+	char * port;
+	char * user;
+	char * pass;
+} ms_t;
+
+static cmdret_t _m_session(ms_t * ms,
+                           char * host,
+                           char * port,
+                           char * user,
+                           char * pass,
+                           int  * reused);
+static void     _m_session_drop(ms_t * ms,
+                                char * host,
+                                char * port,
+                                char * user,
+                                char * pass);
+static void     _m_session_close(ms_t * ms);
+static cmdret_t _m_url_xfer(char * srcurl, char * dsturl);
+static void     _m_next_url(char * urlfile, char ** srcurl, char ** dsturl);
+static void     _m_load_plan(char * urlfile);
+static cmdret_t _m_url_pool(char * urlfile);
+
+static ms_t lsess = { "lopen", "lclose" };
+static ms_t rsess = { "open",  "close"  };
+#endif /* !MSSFTP */
+
 
 static char *  host     = NULL;
 static char *  port     = NULL;
@@ -118,6 +158,9 @@ static char *  pass     = NULL;
 static char *  urlfile  = NULL;
 static char *  srcurl   = NULL;
 static char *  dsturl   = NULL;
+static int     planurls = 0;
+static int     dryrun   = 0;
+static plan_t* urlplan  = NULL;
 static char ** cmdlist  = NULL;
 static int     cmdlen   = 0;
 static char ** optlist  = NULL;
@@ -129,12 +172,6 @@ main(int argc, char * argv[])
 {
 	cmdret_t  cr = CMD_SUCCESS;
 	char * input = NULL;
-	char * shost, * dhost = NULL;
-	char * sport, * dport = NULL;
-	char * suser, * duser = NULL;
-	char * spass, * dpass = NULL;
-	char * spath, * dpath = NULL;
-	int    rval  = 0;
 	int    i     = 0;
 
 #ifdef MSSFTP
@@ -158,6 +195,7 @@ main(int argc, char * argv[])
 	_m_signals();
 	cmd_init();
 	s_init();
+	rl_init();
 
 	globus_module_activate(GLOBUS_GSI_GSSAPI_MODULE);
 
@@ -171,88 +209,40 @@ main(int argc, char * argv[])
 	}
 
 #ifndef MSSFTP
+	if (dryrun)
+	{
+		_m_load_plan(urlfile);
+		plan_print(urlplan);
+		plan_destroy(urlplan);
+		urlplan = NULL;
+		EXIT(0);
+	}
+
+	if (urlfile && s_concurrency() > 1)
+		EXIT(_m_url_pool(urlfile));
+
 	if (srcurl || urlfile)
 	{
 		do {
 			if (urlfile)
-				_m_parse_url_file(urlfile, &srcurl, &dsturl);
+				_m_next_url(urlfile, &srcurl, &dsturl);
 			if (!srcurl)
-				exit(0);
-
-			rval = _m_parse_url(srcurl,
-			                   &shost,
-			                   &sport,
-			                   &suser,
-			                   &spass,
-			                   &spath);
-			if (rval)
-				exit(1);
-	
-			if (dsturl)
-			{
-				rval = _m_parse_url(dsturl,
-				                   &dhost,
-				                   &dport,
-				                   &duser,
-				                   &dpass,
-				                   &dpath);
-	
-				if (rval)
-					exit(1);
-			}
+				break;
 
-			if (shost)
-			{
-				cr = _m_open(dhost ? "lopen" : "open", 
-				             shost,
-				             sport,
-				             suser,
-				             spass);
-				if (cr != CMD_SUCCESS)
-					EXIT(cr);
-			}
-	
-	
-			if (dhost)
-			{
-				cr = _m_open("open", 
-				              dhost,
-				              dport,
-				              duser,
-				              dpass);
-				if (cr != CMD_SUCCESS)
-					EXIT(cr);
-			}
-	
-			input = Sprintf(NULL, cmdlist[0], spath, dpath);
-			cr = cmd_intrptr(input);
-			Free(input);
-			if (cr != CMD_SUCCESS)
-				EXIT(cr);
-	
-			if (shost && dhost)
-				cr = cmd_intrptr("lclose");
-			if (cr != CMD_SUCCESS)
-				EXIT(cr);
-			if (dhost || shost)
-				cr = cmd_intrptr("close");
+			/* Skip entries that an earlier run finished. */
+			if (jn_done(srcurl, dsturl))
+				continue;
+
+			cr = _m_url_xfer(srcurl, dsturl);
 			if (cr != CMD_SUCCESS)
 				EXIT(cr);
-	
-			FREE(dhost);
-			FREE(shost);
-			FREE(dpath);
-			FREE(spath);
-			FREE(dport);
-			FREE(sport);
-			FREE(duser);
-			FREE(suser);
-			FREE(dpass);
-			FREE(spass);
-			dhost = dpath = dport = duser = dpass = NULL;
-			shost = spath = sport = suser = spass = NULL;
-
 		} while (urlfile);
+
+		plan_destroy(urlplan);
+		urlplan = NULL;
+
+		_m_session_close(&lsess);
+		_m_session_close(&rsess);
 		EXIT(0);
 	}
 #endif /* !MSSFTP */
@@ -296,7 +286,7 @@ printf(
        "Usage: uberftp [options] [host options] [host]\n"
        "       uberftp [options] [host options]  host cmds\n"
        "       uberftp [options] <srcurl> <dsturl>\n"
-       "       uberftp [options] -f <urlfile>\n"
+       "       uberftp [options] [-plan] [-dryrun] -f <urlfile>\n"
        "       uberftp [options] -cmd <url>\n"
        "\n"
 
@@ -320,7 +310,11 @@ printf(
   "\turlfile\n"
   "\t          This file is a list of <srcurl> <dsturl> pairs, one pair \n"
   "\t          per line. Blanks lines and lines beginning with '#' are\n"
-  "\t          ignored.\n"
+  "\t          ignored. Consecutive pairs on the same host reuse the\n"
+  "\t          connection.\n"
+  "\t-plan     Reorder the url file by host pair, size and directory\n"
+  "\t          before running it.\n"
+  "\t-dryrun   Print the url file in the order it would run and exit.\n"
   "\t-cmd <url>\n"
   "\t          This will execute the given command using the url as the\n"
   "\t          target. The supported commands and their syntax are listed\n"
@@ -340,14 +334,25 @@ printf(
   "The \"options\" are:\n"
   "\t-active       Use ACTIVE mode for data transfers.\n"
   "\t-ascii        Use ASCII mode for data transfers.\n"
+  "\t-autoparallel n\n"
+  "\t              Tune parallel data channels per host, up to n.\n"
+  "\t-autotcpbuf n  Size TCP buffers per host from the round trip time so\n"
+  "\t              one data connection can carry n bytes per second.\n"
   "\t-binary       Use BINARY mode for data transfers.\n"
   "\t-blksize n    Set the internal buffer size to n.\n"
   "\t-cksum [on|off]\n"
   "\t              Enable/Disable CRC checks after file transfers.\n"
+  "\t-concurrency n\n"
+  "\t              Transfer up to n files at a time during recursive and\n"
+  "\t              multiple file transfers and url file entries.\n"
+  "\t-congestion name\n"
+  "\t              Use TCP congestion control algorithm name.\n"
 #ifdef MSSFTP
   "\t-d            Enable debugging. Same as '-debug 3'. Deprecated.\n"
 #endif /* MSSFTP */
   "\t-debug   n    Set the debug level to n.\n"
+  "\t-directio [on|off]\n"
+  "\t              Enable/Disable O_DIRECT for local files.\n"
   "\t-family  name Set the storage family to name.\n"
   "\t-cos     name Set the storage class of service to name.\n"
 #ifdef MSSFTP
@@ -356,22 +361,41 @@ printf(
   "\t-glob [on|off]\n"
   "\t              Enable/Disable filename globbing.\n"
   "\t-hash         Enable hashing.\n"
+  "\t-hostlimit n  Keep at most n url file transfers in flight per host\n"
+  "\t              when -concurrency is greater than one.\n"
+  "\t-ioengine [sync|uring]\n"
+  "\t              Read and write local files with blocking calls (sync)\n"
+  "\t              or through io_uring (uring).\n"
+  "\t-journal file Skip files recorded in file and record each file that\n"
+  "\t              completes during url file and recursive transfers.\n"
   "\t-keepalive n  Send control channel keepalive messages every n\n"
   "\t              seconds during data transfers.\n"
+  "\t-metrics file Append per transfer metrics to file as JSON lines.\n"
   "\t-mode  [E|S]  Switch the transfer mode to extend block (E) or\n"
   "\t              streams mode(S).\n"
   "\t-parallel n   Use n parallel data channels during extended block\n"
   "\t              transfers.\n"
   "\t-passive      Use PASSIVE mode for data transfers.\n"
   "\t-pbsz  n      Set the data protection buffer size to n bytes.\n"
+  "\t-pipeline n   Read up to n blocks ahead of the destination during\n"
+  "\t              transfers. 0 disables read ahead.\n"
   "\t-prot [C|S|E|P|]\n"
   "\t              Set the data protection level to clear (C),\n"
   "\t              safe (S), confidential (E) or private (P).\n"
+  "\t-ratelimit n  Cap all data channel traffic at n bytes per second.\n"
+  "\t-rateburst n  Let the data channels burst n bytes past ratelimit.\n"
   "\t-retry n      Retry commands that fail with transient errors n times.\n"
+  "\t-reorder n    Hold up to n bytes of out of order data for pipes.\n"
+  "\t-restartdir dir\n"
+  "\t              Save the ranges each transfer completed in dir.\n"
   "\t-resume path  Retry the recursive transfer starting at path.\n"
+  "\t-stripeblock n\n"
+  "\t              Send blocks to the stripe that owns them, n bytes per\n"
+  "\t              stripe block.\n"
   "\t-tcpbuf n     Set the TCP read/write buffers to n bytes.\n"
   "\t-wait         This will cause the client to wait for remote files to\n"
   "\t              stage before attempting to transfer them.\n"
+  "\t-zerocopy n   Send data blocks of n bytes or more with MSG_ZEROCOPY.\n"
 #ifdef MSSFTP
   "\t-v            Enable verbose mode. Same as '-debug 3'. Deprecated.\n"
 #else /* MSSFTP */
@@ -559,10 +583,15 @@ _m_is_opt_arg(char * argv[], int * i)
 	if ((val = _m_grab_opt_arg(argv, "-a",         i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-active",    i, 0))||
 	    (val = _m_grab_opt_arg(argv, "-ascii",     i, 0))||
+	    (val = _m_grab_opt_arg(argv, "-autoparallel", i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-autotcpbuf", i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-binary",    i, 0))||
 	    (val = _m_grab_opt_arg(argv, "-blksize",   i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-cksum",     i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-concurrency", i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-congestion", i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-debug",     i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-directio",  i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-family",    i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-cos",       i, 1))||
 #ifdef MSSFTP
@@ -572,17 +601,28 @@ _m_is_opt_arg(char * argv[], int * i)
 #endif /* MSSFTP */
 	    (val = _m_grab_opt_arg(argv, "-glob",      i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-hash",      i, 0))||
+	    (val = _m_grab_opt_arg(argv, "-hostlimit", i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-help",      i, 0))||
+	    (val = _m_grab_opt_arg(argv, "-ioengine",  i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-journal",   i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-keepalive", i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-metrics",   i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-mode",      i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-parallel",  i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-passive",   i, 0))||
 	    (val = _m_grab_opt_arg(argv, "-pbsz",      i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-pipeline",  i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-prot",      i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-rateburst", i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-ratelimit", i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-reorder",   i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-restartdir", i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-resume",    i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-retry",     i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-stripeblock", i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-tcpbuf",    i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-wait",      i, 0))||
+	    (val = _m_grab_opt_arg(argv, "-zerocopy",  i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-v",         i, 0))||
 	    (val = _m_grab_opt_arg(argv, "-version",   i, 0))||
 	    (val = _m_grab_opt_arg(argv, "-versions",  i, 0))||
@@ -660,10 +700,15 @@ _m_check_options(char * argv[], int * i)
 
 	if ((val = _m_grab_opt_arg(argv, "-active",    i, 0))||
 	    (val = _m_grab_opt_arg(argv, "-ascii",     i, 0))||
+	    (val = _m_grab_opt_arg(argv, "-autoparallel", i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-autotcpbuf", i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-binary",    i, 0))||
 	    (val = _m_grab_opt_arg(argv, "-blksize",   i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-cksum",     i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-concurrency", i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-congestion", i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-debug",     i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-directio",  i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-family",    i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-cos",       i, 1))||
 #ifdef MSSFTP
@@ -674,16 +719,27 @@ _m_check_options(char * argv[], int * i)
 #endif /* MSSFTP */
 	    (val = _m_grab_opt_arg(argv, "-glob",      i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-hash",      i, 0))||
+	    (val = _m_grab_opt_arg(argv, "-hostlimit", i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-ioengine",  i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-journal",   i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-keepalive", i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-metrics",   i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-mode",      i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-parallel",  i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-passive",   i, 0))||
 	    (val = _m_grab_opt_arg(argv, "-pbsz",      i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-pipeline",  i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-prot",      i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-rateburst", i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-ratelimit", i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-reorder",   i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-restartdir", i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-resume",    i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-retry",     i, 1))||
+	    (val = _m_grab_opt_arg(argv, "-stripeblock", i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-tcpbuf",    i, 1))||
 	    (val = _m_grab_opt_arg(argv, "-wait",      i, 0))||
+	    (val = _m_grab_opt_arg(argv, "-zerocopy",  i, 1))||
 	    (val = _m_grab_dcau_arg(argv, i)))
 	{
 		/* Special Cases for mssftp. */
@@ -972,6 +1028,10 @@ _m_is_url_arg(char * arg)
 {
 	if (strcmp(arg, "-f") == 0)
 		return 1;
+	if (strcmp(arg, "-plan") == 0)
+		return 1;
+	if (strcmp(arg, "-dryrun") == 0)
+		return 1;
 	if (_m_is_url(arg))
 		return 1;
 	return 0;
@@ -993,6 +1053,18 @@ _m_parse_url_args(int argc, char * argv[])
 				continue;
 		}
 
+		if (strcmp(argv[i], "-plan") == 0)
+		{
+			planurls = 1;
+			continue;
+		}
+
+		if (strcmp(argv[i], "-dryrun") == 0)
+		{
+			dryrun = 1;
+			continue;
+		}
+
 		if (!_m_is_url(argv[i]) || urlfile)
 		{
 			fprintf(stderr, "Illegal option %s.\n", argv[i]);
@@ -1257,5 +1329,738 @@ _m_open(char * cmd, char * host, char * port, char * user, char * pass)
 	return cmd_intrptr(input);
 }
 
+#ifndef MSSFTP
+static int
+_m_same(char * a, char * b)
+{
+	if (!a || !b)
+		return a == b;
+	return strcmp(a, b) == 0;
+}
+
+/* Is ms open to host, port, user and password? */
+static int
+_m_session_is(ms_t * ms, char * host, char * port, char * user, char * pass)
+{
+	return ms->host && host          &&
+	       _m_same(ms->host, host)   &&
+	       _m_same(ms->port, port)   &&
+	       _m_same(ms->user, user)   &&
+	       _m_same(ms->pass, pass);
+}
+
+/* Close ms unless it is the session for host. */
+static void
+_m_session_drop(ms_t * ms, char * host, char * port, char * user, char * pass)
+{
+	if (!_m_session_is(ms, host, port, user, pass))
+		_m_session_close(ms);
+}
+
+/*
+ * Make ms the session for host. If ms is already open to the same
+ * host, port, user and password, it is kept and *reused is set.
+ * Otherwise ms is closed and, if host is not NULL, reopened.
+ */
+static cmdret_t
+_m_session(ms_t * ms,
+           char * host,
+           char * port,
+           char * user,
+           char * pass,
+           int  * reused)
+{
+	cmdret_t cr = CMD_SUCCESS;
+
+	*reused = 0;
+
+	if (_m_session_is(ms, host, port, user, pass))
+	{
+		*reused = 1;
+		return CMD_SUCCESS;
+	}
+
+	_m_session_close(ms);
+
+	if (!host)
+		return CMD_SUCCESS;
+
+	cr = _m_open(ms->open, host, port, user, pass);
+	if (cr != CMD_SUCCESS)
+		return cr;
+
+	ms->host = Strdup(host);
+	ms->port = Strdup(port);
+	ms->user = Strdup(user);
+	ms->pass = Strdup(pass);
+	return CMD_SUCCESS;
+}
+
+static void
+_m_session_close(ms_t * ms)
+{
+	if (!ms->host)
+		return;
+
+	cmd_intrptr(ms->close);
+
+	FREE(ms->host);
+	FREE(ms->port);
+	FREE(ms->user);
+	FREE(ms->pass);
+	ms->host = ms->port = ms->user = ms->pass = NULL;
+}
+
+/*
+ * Transfer srcurl to dsturl, reusing the URL mode sessions when the
+ * endpoints have not changed.
+ */
+static cmdret_t
+_m_url_xfer(char * srcurl, char * dsturl)
+{
+	cmdret_t cr      = CMD_SUCCESS;
+	char   * input   = NULL;
+	char   * shost   = NULL;
+	char   * dhost   = NULL;
+	char   * sport   = NULL;
+	char   * dport   = NULL;
+	char   * suser   = NULL;
+	char   * duser   = NULL;
+	char   * spass   = NULL;
+	char   * dpass   = NULL;
+	char   * spath   = NULL;
+	char   * dpath   = NULL;
+	int      lreused = 0;
+	int      rreused = 0;
+
+	if (_m_parse_url(srcurl, &shost, &sport, &suser, &spass, &spath))
+		exit(1);
+
+	if (dsturl && _m_parse_url(dsturl, &dhost, &dport, &duser, &dpass, &dpath))
+		exit(1);
+
+	/* Let go of sessions this entry will not reuse before opening any. */
+	_m_session_drop(&lsess, dhost ? shost : NULL, sport, suser, spass);
+	_m_session_drop(&rsess, 
+	                dhost ? dhost : shost,
+	                dhost ? dport : sport,
+	                dhost ? duser : suser,
+	                dhost ? dpass : spass);
+
+	/*
+	 * The local session is the source host of a third party
+	 * transfer. The remote session is the destination host if
+	 * there is one, otherwise the source host.
+	 */
+	cr = _m_session(&lsess, 
+	                dhost ? shost : NULL,
+	                sport,
+	                suser,
+	                spass,
+	                &lreused);
+	if (cr != CMD_SUCCESS)
+		goto cleanup;
+
+	cr = _m_session(&rsess, 
+	                dhost ? dhost : shost,
+	                dhost ? dport : sport,
+	                dhost ? duser : suser,
+	                dhost ? dpass : spass,
+	                &rreused);
+	if (cr != CMD_SUCCESS)
+		goto cleanup;
+
+	input = Sprintf(NULL, cmdlist[0], spath, dpath);
+	cr = cmd_intrptr(input);
+
+	/*
+	 * A reused session may have been dropped by the server while
+	 * it sat idle. If that is why the entry failed, reconnect and
+	 * try it once more; any other failure would just repeat.
+	 */
+	if (cr != CMD_SUCCESS)
+	{
+		lreused = lreused && ((cr & CMD_ERR_CONNECT) || cmd_lost(1));
+		rreused = rreused && ((cr & CMD_ERR_CONNECT) || cmd_lost(0));
+	}
+
+	if (cr != CMD_SUCCESS && (lreused || rreused))
+	{
+		o_printf(DEBUG_NORMAL, "Retrying with a new session...\n");
+
+		if (lreused)
+			_m_session_close(&lsess);
+		if (rreused)
+			_m_session_close(&rsess);
+
+		cr = _m_session(&lsess, 
+		                dhost ? shost : NULL,
+		                sport,
+		                suser,
+		                spass,
+		                &lreused);
+		if (cr == CMD_SUCCESS)
+			cr = _m_session(&rsess, 
+			                dhost ? dhost : shost,
+			                dhost ? dport : sport,
+			                dhost ? duser : suser,
+			                dhost ? dpass : spass,
+			                &rreused);
+		if (cr == CMD_SUCCESS)
+			cr = cmd_intrptr(input);
+	}
+
+	if (cr == CMD_SUCCESS)
+		jn_add(srcurl, dsturl);
+
+cleanup:
+	Free(input);
+	FREE(dhost);
+	FREE(shost);
+	FREE(dpath);
+	FREE(spath);
+	FREE(dport);
+	FREE(sport);
+	FREE(duser);
+	FREE(suser);
+	FREE(dpass);
+	FREE(spass);
+	return cr;
+}
+
+/*
+ * Parallel url files. With -concurrency n, url file entries are handed to
+ * n worker processes (see worker.h). Each worker keeps its own URL mode
+ * sessions, so an entry goes to an idle worker that already holds its
+ * sessions when there is one. Entries are dispatched in file order. With
+ * s_hostlimit(), the sessions the workers hold open, busy or idle, are
+ * counted per host; an entry that would open one too many waits for a
+ * transfer to finish. Results are reported in file order and every entry
+ * is attempted; the exit code is the union of the per entry results.
+ */
+
+/* A url file entry handed to the pool. */
+typedef struct {
+	char   * srcurl;
+	char   * dsturl;
+	char   * hosts[2]; /* Source and destination hosts, NULL for file:// */
+	int      worker;   /* Worker running the entry, -1 if none. */
+	int      done;
+	cmdret_t cr;
+} mu_t;
+
+/* Hosts of the sessions a worker holds, as lsess and rsess. */
+typedef struct {
+	char * hosts[2];
+	char * gone[2]; /* Dropped for the job in progress; closed by its end. */
+} mw_t;
+
+typedef struct {
+	mu_t   * urls;
+	int      cnt;    /* Entries dispatched. */
+	int      next;   /* Next entry to report. */
+	mw_t   * workers;
+	int      nworkers;
+	cmdret_t cr;
+} mp_t;
+
+/* The hosts _m_url_xfer() keeps lsess and rsess open to for mu. */
+static void
+_m_pool_need(mu_t * mu, char ** need)
+{
+	need[0] = mu->hosts[1] ? mu->hosts[0] : NULL;
+	need[1] = mu->hosts[1] ? mu->hosts[1] : mu->hosts[0];
+}
+
+static int
+_m_pool_same(char * a, char * b)
+{
+	return a && b && strcasecmp(a, b) == 0;
+}
+
+/* Sessions open to host across the workers. */
+static int
+_m_pool_open(mp_t * mp, char * host)
+{
+	int w   = 0;
+	int i   = 0;
+	int cnt = 0;
+
+	for (w = 0; w < mp->nworkers; w++)
+	{
+		for (i = 0; i < 2; i++)
+		{
+			if (_m_pool_same(mp->workers[w].hosts[i], host))
+				cnt++;
+			if (_m_pool_same(mp->workers[w].gone[i], host))
+				cnt++;
+		}
+	}
+	return cnt;
+}
+
+/*
+ * Record that worker w is being handed an entry needing need[]. Sessions
+ * it drops still count until the entry is done, since the worker closes
+ * them only once it picks the entry up.
+ */
+static void
+_m_pool_held(mp_t * mp, int w, char ** need)
+{
+	mw_t * mw = &mp->workers[w];
+	int    i  = 0;
+
+	for (i = 0; i < 2; i++)
+	{
+		if (_m_pool_same(mw->hosts[i], need[i]))
+			continue;
+
+		FREE(mw->gone[i]);
+		mw->gone[i]  = mw->hosts[i];
+		mw->hosts[i] = Strdup(need[i]);
+	}
+}
+
+/* Worker w finished its entry, or is gone if lost is set. */
+static void
+_m_pool_free(mp_t * mp, int w, int lost)
+{
+	int i = 0;
+
+	for (i = 0; i < 2; i++)
+	{
+		FREE(mp->workers[w].gone[i]);
+		if (lost)
+			FREE(mp->workers[w].hosts[i]);
+	}
+}
+
+/* Can worker w take an entry needing need[] within the per host limit? */
+static int
+_m_pool_fits(mp_t * mp, int w, char ** need)
+{
+	char * held[2];
+	int    fits = 1;
+	int    i    = 0;
+
+	if (!s_hostlimit())
+		return 1;
+
+	/* Count as if w had already closed the sessions it holds. */
+	memcpy(held, mp->workers[w].hosts, sizeof(held));
+	memset(mp->workers[w].hosts, 0, sizeof(held));
+
+	for (i = 0; i < 2; i++)
+	{
+		/* A session w already holds adds nothing. */
+		if (!need[i] || _m_pool_same(held[i], need[i]))
+			continue;
+
+		/* need[] may name one host twice. */
+		if (_m_pool_open(mp, need[i]) + 
+		    _m_pool_same(need[!i], need[i]) + 1 > s_hostlimit())
+			fits = 0;
+	}
+
+	memcpy(mp->workers[w].hosts, held, sizeof(held));
+	return fits;
+}
+
+/* Job ids that tell worker w to close its sessions. */
+#define MP_DROP(w)     (-2 - (w))
+#define MP_DROPPED(id) (-2 - (id))
+
+/* Does worker w hold a session to either of need[]? */
+static int
+_m_pool_holds(mp_t * mp, int w, char ** need)
+{
+	int i = 0;
+
+	for (i = 0; i < 2; i++)
+	{
+		if (_m_pool_same(mp->workers[w].hosts[i], need[0]) ||
+		    _m_pool_same(mp->workers[w].hosts[i], need[1]))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Have an idle worker that holds a session to one of need[] close its
+ * sessions. Returns non zero if there was none.
+ */
+static int
+_m_pool_drop(mp_t * mp, wp_t * wp, char ** need)
+{
+	errcode_t ec = EC_SUCCESS;
+	char    * none[2];
+	int       w  = 0;
+
+	none[0] = none[1] = NULL;
+	for (w = 0; w < mp->nworkers; w++)
+	{
+		if (wp_state(wp, w) != 0 || !_m_pool_holds(mp, w, need))
+			continue;
+
+		_m_pool_held(mp, w, none);
+		ec = wp_submit_to(wp, w, MP_DROP(w), "", 0);
+		if (!ec)
+			return 0;
+
+		ec_destroy(ec);
+		_m_pool_free(mp, w, 1);
+	}
+	return 1;
+}
+
+/*
+ * Choose an idle worker for an entry needing need[], preferring one that
+ * already holds those sessions. While no idle worker fits under the per
+ * host limit, idle sessions in the way are closed and running transfers
+ * are waited on; if nothing is left to wait for, any idle worker will do.
+ * Returns -1 if no workers remain.
+ */
+static int
+_m_pool_pick(mp_t * mp, wp_t * wp, char ** need)
+{
+	int w      = 0;
+	int i      = 0;
+	int score  = 0;
+	int best   = -1;
+	int bscore = -3;
+	int force  = 0;
+
+	while (1)
+	{
+		for (w = 0; w < mp->nworkers; w++)
+		{
+			if (wp_state(wp, w) != 0)
+				continue;
+
+			if (!force && !_m_pool_fits(mp, w, need))
+				continue;
+
+			/* Reuse what it holds; failing that, tear down the least. */
+			for (score = i = 0; i < 2; i++)
+			{
+				if (_m_pool_same(mp->workers[w].hosts[i], need[i]))
+					score += 2;
+				else if (mp->workers[w].hosts[i])
+					score--;
+			}
+
+			if (score > bscore)
+			{
+				best   = w;
+				bscore = score;
+			}
+		}
+
+		if (best != -1 || force)
+			return best;
+
+		/* Close idle sessions in the way, else wait on a transfer. */
+		if (!_m_pool_drop(mp, wp, need))
+			wp_wait(wp);
+		else if (wp_wait(wp))
+			force = 1;
+	}
+}
+
+static int
+_m_pool_run(void * arg, char * job, size_t len)
+{
+	/* An empty job asks us to let go of our sessions. */
+	if (!len)
+	{
+		_m_session_close(&lsess);
+		_m_session_close(&rsess);
+		return CMD_SUCCESS;
+	}
+
+	return _m_url_xfer(job, job + strlen(job) + 1);
+}
 
+static void
+_m_pool_stop(void * arg)
+{
+	_m_session_close(&lsess);
+	_m_session_close(&rsess);
+}
+
+static void
+_m_pool_done(void * arg, int id, int result)
+{
+	mp_t * mp = (mp_t *) arg;
+	mu_t * mu = NULL;
 
+	if (id < -1)
+	{
+		_m_pool_free(mp, MP_DROPPED(id), result == WP_LOST);
+		return;
+	}
+
+	mu = &mp->urls[id];
+
+	/* A lost worker's sessions went with it. */
+	if (mu->worker != -1)
+		_m_pool_free(mp, mu->worker, result == WP_LOST);
+
+	if (result == WP_LOST)
+	{
+		o_fprintf(stderr,
+		          DEBUG_ERRS_ONLY,
+		          "%s: Transfer process exited unexpectedly.\n",
+		          mu->srcurl);
+		result = CMD_ERR_OTHER;
+	}
+
+	mu->done = 1;
+	mu->cr   = result;
+	mp->cr  |= result;
+
+	/* Report everything up to the first entry still in flight. */
+	for (; mp->next < mp->cnt && mp->urls[mp->next].done; mp->next++)
+	{
+		mu = &mp->urls[mp->next];
+		if (mu->cr == CMD_SUCCESS)
+			o_printf(DEBUG_NORMAL,
+			         "%s -> %s: ok\n",
+			         mu->srcurl,
+			         mu->dsturl);
+		else
+			o_fprintf(stderr,
+			          DEBUG_ERRS_ONLY,
+			          "%s -> %s: failed\n",
+			          mu->srcurl,
+			          mu->dsturl);
+
+		FREE(mu->srcurl);
+		FREE(mu->dsturl);
+		FREE(mu->hosts[0]);
+		FREE(mu->hosts[1]);
+	}
+}
+
+static wpi_t _m_pool_wpi = {
+	NULL,
+	_m_pool_run,
+	_m_pool_stop,
+	_m_pool_done,
+};
+
+static cmdret_t
+_m_url_pool(char * urlfile)
+{
+	errcode_t ec     = EC_SUCCESS;
+	wp_t    * wp     = NULL;
+	mu_t    * mu     = NULL;
+	char    * srcurl = NULL;
+	char    * dsturl = NULL;
+	char    * job    = NULL;
+	char    * port   = NULL;
+	char    * user   = NULL;
+	char    * pass   = NULL;
+	char    * path   = NULL;
+	size_t    slen   = 0;
+	size_t    dlen   = 0;
+	int       i      = 0;
+	int       w      = 0;
+	char    * need[2];
+	mp_t      mp;
+
+	memset(&mp, 0, sizeof(mp_t));
+
+	jn_load();
+	ec = wp_init(&wp, s_concurrency(), &_m_pool_wpi, &mp);
+	if (ec)
+	{
+		/* Carry on by ourselves. */
+		ec_print(ec);
+		ec_destroy(ec);
+		wp = NULL;
+	}
+
+	if (wp)
+	{
+		mp.nworkers = wp_count(wp);
+		mp.workers  = (mw_t *) malloc(sizeof(mw_t) * mp.nworkers);
+		memset(mp.workers, 0, sizeof(mw_t) * mp.nworkers);
+	}
+
+	while (1)
+	{
+		_m_next_url(urlfile, &srcurl, &dsturl);
+		if (!srcurl)
+			break;
+
+		mp.urls = (mu_t *) realloc(mp.urls, sizeof(mu_t) * (mp.cnt + 1));
+		mu = &mp.urls[mp.cnt];
+		memset(mu, 0, sizeof(mu_t));
+		mu->srcurl = Strdup(srcurl);
+		mu->dsturl = Strdup(dsturl);
+		mu->worker = -1;
+
+		/* Catch bad urls before any worker sees them. */
+		for (i = 0; i < 2; i++)
+		{
+			if (_m_parse_url(i ? dsturl : srcurl,
+			                 &mu->hosts[i],
+			                 &port,
+			                 &user,
+			                 &pass,
+			                 &path))
+				exit(1);
+			FREE(port);
+			FREE(user);
+			FREE(pass);
+			FREE(path);
+			port = user = pass = path = NULL;
+		}
+
+		/* Entries that an earlier run finished count as done. */
+		if (jn_done(srcurl, dsturl))
+		{
+			mp.cnt++;
+			_m_pool_done(&mp, mp.cnt - 1, CMD_SUCCESS);
+			continue;
+		}
+
+		mp.cnt++;
+
+		slen = strlen(srcurl) + 1;
+		dlen = strlen(dsturl) + 1;
+		job  = (char *) malloc(slen + dlen);
+		memcpy(job, srcurl, slen);
+		memcpy(job + slen, dsturl, dlen);
+
+		_m_pool_need(mu, need);
+		w = -1;
+		while (wp && (w = _m_pool_pick(&mp, wp, need)) != -1)
+		{
+			_m_pool_held(&mp, w, need);
+			ec = wp_submit_to(wp, w, mp.cnt - 1, job, slen + dlen);
+			if (!ec)
+				break;
+
+			/* That worker is gone; try another. */
+			ec_destroy(ec);
+			_m_pool_free(&mp, w, 1);
+		}
+		FREE(job);
+
+		if (w != -1)
+		{
+			mu->worker = w;
+			continue;
+		}
+
+		if (wp)
+		{
+			/* The pool is gone; carry on by ourselves. */
+			o_fprintf(stderr, 
+			          DEBUG_ERRS_ONLY, 
+			          "No worker processes remain\n");
+			wp_destroy(wp);
+			wp = NULL;
+		}
+
+		_m_pool_done(&mp, mp.cnt - 1, _m_url_xfer(srcurl, dsturl));
+	}
+
+	wp_destroy(wp);
+
+	plan_destroy(urlplan);
+	urlplan = NULL;
+
+	_m_session_close(&lsess);
+	_m_session_close(&rsess);
+
+	for (i = 0; i < mp.nworkers; i++)
+		_m_pool_free(&mp, i, 1);
+	FREE(mp.workers);
+	FREE(mp.urls);
+	return mp.cr;
+}
+
+/*
+ * Read every url file entry (or the command line pair) into urlplan.
+ * Local sources are sized with stat() so the plan can start large files
+ * first; remote sizes are not looked up. Entries that the journal says an
+ * earlier run finished are left out, so -dryrun shows what would run.
+ */
+static void
+_m_load_plan(char * urlfile)
+{
+	char         * src   = srcurl;
+	char         * dst   = dsturl;
+	char         * shost = NULL;
+	char         * dhost = NULL;
+	char         * spath = NULL;
+	char         * dpath = NULL;
+	char         * port  = NULL;
+	char         * user  = NULL;
+	char         * pass  = NULL;
+	globus_off_t   size  = 0;
+	struct stat    st;
+
+	urlplan = plan_init();
+
+	while (1)
+	{
+		if (urlfile)
+			_m_parse_url_file(urlfile, &src, &dst);
+		if (!src)
+			break;
+
+		if (_m_parse_url(src, &shost, &port, &user, &pass, &spath))
+			exit(1);
+		FREE(port);
+		FREE(user);
+		FREE(pass);
+
+		if (_m_parse_url(dst, &dhost, &port, &user, &pass, &dpath))
+			exit(1);
+		FREE(port);
+		FREE(user);
+		FREE(pass);
+
+		size = -1;
+		if (!shost && stat(spath, &st) == 0 && S_ISREG(st.st_mode))
+			size = st.st_size;
+
+		if (!jn_done(src, dst))
+			plan_add(urlplan, src, dst, shost, dhost, spath, dpath, size);
+
+		FREE(shost);
+		FREE(dhost);
+		FREE(spath);
+		FREE(dpath);
+		port = user = pass = shost = dhost = spath = dpath = NULL;
+
+		if (!urlfile)
+			break;
+	}
+
+	if (planurls)
+		plan_sort(urlplan);
+}
+
+/*
+ * Next url file entry, in plan order with -plan, otherwise in file order.
+ */
+static void
+_m_next_url(char * urlfile, char ** srcurl, char ** dsturl)
+{
+	if (!planurls)
+	{
+		_m_parse_url_file(urlfile, srcurl, dsturl);
+		return;
+	}
+
+	if (!urlplan)
+		_m_load_plan(urlfile);
+
+	plan_next(urlplan, srcurl, dsturl);
+}
+#endif /* !MSSFTP */
@@ -0,0 +1,403 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <globus_common.h>
+
+#include "settings.h"
+#include "metrics.h"
+#include "output.h"
+#include "misc.h"
+
+#ifdef DMALLOC
+#include "dmalloc.h"
+#endif /* DMALLOC */
+
+typedef struct {
+	globus_off_t  bytes;
+	unsigned long blocks;
+	int           stripe;
+} mxc_t;
+
+struct _mx {
+	char         * src;
+	char         * dst;
+	struct timeval start;
+	globus_off_t   bytes;
+	int            retries;
+	int            zcopy;
+	long long      usec[MX_TIMERS];
+	mxc_t        * chans;
+	int            chancnt;
+};
+
+static int  active = 0;
+static mx_t mx;
+
+/*
+ * A thread that is not the transfer's own counts into the mx_t bound to it
+ * by mx_defer() instead of mx.
+ */
+static pthread_key_t  mxkey;
+static pthread_once_t mxonce = PTHREAD_ONCE_INIT;
+
+static void
+_mx_free(void * arg)
+{
+	mx_t * m = (mx_t *) arg;
+
+	if (!m)
+		return;
+	FREE(m->chans);
+	FREE(m);
+}
+
+static void
+_mx_key(void)
+{
+	pthread_key_create(&mxkey, _mx_free);
+}
+
+static mx_t *
+_mx_self(void)
+{
+	mx_t * m = NULL;
+
+	pthread_once(&mxonce, _mx_key);
+	m = (mx_t *) pthread_getspecific(mxkey);
+	return m ? m : &mx;
+}
+
+static long long
+_mx_usec(struct timeval * start, struct timeval * stop)
+{
+	return (long long)(stop->tv_sec - start->tv_sec) * 1000000 +
+	       (stop->tv_usec - start->tv_usec);
+}
+
+static char *
+_mx_json_str(char * line, char * str)
+{
+	char * esc = NULL;
+	int    i   = 0;
+	int    j   = 0;
+
+	/* Worst case every character becomes \u00XX. */
+	esc = (char *) malloc(strlen(str) * 6 + 1);
+
+	for (i = 0; str[i] != '\0'; i++)
+	{
+		switch (str[i])
+		{
+		case '"':
+		case '\\':
+			esc[j++] = '\\';
+			esc[j++] = str[i];
+			break;
+		default:
+			if ((unsigned char)str[i] < 0x20)
+			{
+				sprintf(esc + j, "\\u%04x", (unsigned char)str[i]);
+				j += 6;
+			} else
+				esc[j++] = str[i];
+			break;
+		}
+	}
+	esc[j] = '\0';
+
+	line = Sprintf(line, "%s\"%s\"", line, esc);
+	FREE(esc);
+	return line;
+}
+
+void
+mx_start(char * src, char * dst)
+{
+	FREE(mx.src);
+	FREE(mx.dst);
+	FREE(mx.chans);
+	memset(&mx, 0, sizeof(mx_t));
+
+	active = s_metrics() != NULL;
+	if (!active)
+		return;
+
+	mx.src = Strdup(src);
+	mx.dst = Strdup(dst);
+	gettimeofday(&mx.start, NULL);
+}
+
+void
+mx_retry(void)
+{
+	_mx_self()->retries++;
+}
+
+void
+mx_zcopy(void)
+{
+	_mx_self()->zcopy = 1;
+}
+
+void
+mx_bytes(size_t len)
+{
+	_mx_self()->bytes += len;
+}
+
+static void
+_mx_chan(mx_t * m, int chan, int stripe, globus_off_t bytes, unsigned long blocks)
+{
+	if (chan >= m->chancnt)
+	{
+		m->chans = (mxc_t *) realloc(m->chans, sizeof(mxc_t) * (chan + 1));
+		memset(m->chans + m->chancnt,
+		       0,
+		       sizeof(mxc_t) * (chan + 1 - m->chancnt));
+		m->chancnt = chan + 1;
+	}
+
+	m->chans[chan].bytes  += bytes;
+	m->chans[chan].blocks += blocks;
+	m->chans[chan].stripe  = stripe;
+}
+
+void
+mx_chan(int chan, int stripe, size_t len)
+{
+	if (!active)
+		return;
+
+	_mx_chan(_mx_self(), chan, stripe, len, 1);
+}
+
+void
+mx_now(struct timeval * tv)
+{
+	if (active)
+		gettimeofday(tv, NULL);
+}
+
+void
+mx_add(int which, struct timeval * tv)
+{
+	struct timeval now;
+
+	if (!active)
+		return;
+
+	gettimeofday(&now, NULL);
+	_mx_self()->usec[which] += _mx_usec(tv, &now);
+}
+
+void
+mx_defer(void)
+{
+	mx_t * m = NULL;
+
+	pthread_once(&mxonce, _mx_key);
+	m = (mx_t *) malloc(sizeof(mx_t));
+	memset(m, 0, sizeof(mx_t));
+	pthread_setspecific(mxkey, m);
+}
+
+mx_t *
+mx_take(void)
+{
+	mx_t * m = NULL;
+
+	pthread_once(&mxonce, _mx_key);
+	m = (mx_t *) pthread_getspecific(mxkey);
+	if (!m || !active)
+		return NULL;
+
+	mx_defer();
+	return m;
+}
+
+void
+mx_merge(mx_t * m)
+{
+	int i = 0;
+
+	if (!m)
+		return;
+
+	mx.bytes   += m->bytes;
+	mx.retries += m->retries;
+	mx.zcopy   |= m->zcopy;
+
+	for (i = 0; i < MX_TIMERS; i++)
+		mx.usec[i] += m->usec[i];
+
+	for (i = 0; i < m->chancnt; i++)
+	{
+		if (m->chans[i].blocks)
+			_mx_chan(&mx,
+			         i,
+			         m->chans[i].stripe,
+			         m->chans[i].bytes,
+			         m->chans[i].blocks);
+	}
+
+	_mx_free(m);
+}
+
+void
+mx_finish(int success)
+{
+	int            i    = 0;
+	int            s    = 0;
+	int            fd   = -1;
+	int            scnt = 0;
+	char         * line = NULL;
+	long long      usec = 0;
+	mxc_t        * sum  = NULL;
+	struct timeval stop;
+
+	if (!active)
+		return;
+	active = 0;
+
+	gettimeofday(&stop, NULL);
+	usec = _mx_usec(&mx.start, &stop);
+
+	line = Sprintf(NULL, "{\"src\":");
+	line = _mx_json_str(line, mx.src);
+	line = Sprintf(line, "%s,\"dst\":", line);
+	line = _mx_json_str(line, mx.dst);
+	line = Sprintf(line,
+	               "%s,\"start\":%ld.%06ld,\"result\":\"%s\""
+	               ",\"bytes\":%"GLOBUS_OFF_T_FORMAT
+	               ",\"seconds\":%.6f,\"rate\":%.0f"
+	               ",\"retries\":%d,\"zcopy\":%s"
+	               ",\"read_s\":%.6f,\"write_s\":%.6f,\"eb_poll_s\":%.6f"
+	               ",\"gss_wrap_s\":%.6f,\"gss_unwrap_s\":%.6f"
+	               ",\"channels\":[",
+	               line,
+	               (long) mx.start.tv_sec,
+	               (long) mx.start.tv_usec,
+	               success ? "ok" : "error",
+	               mx.bytes,
+	               usec / 1000000.0,
+	               usec ? mx.bytes * 1000000.0 / usec : 0.0,
+	               mx.retries,
+	               mx.zcopy ? "true" : "false",
+	               mx.usec[MX_READ] / 1000000.0,
+	               mx.usec[MX_WRITE] / 1000000.0,
+	               mx.usec[MX_EB_POLL] / 1000000.0,
+	               mx.usec[MX_GSS_WRAP] / 1000000.0,
+	               mx.usec[MX_GSS_UNWRAP] / 1000000.0);
+
+	for (i = 0; i < mx.chancnt; i++)
+	{
+		line = Sprintf(line,
+		               "%s%s{\"bytes\":%"GLOBUS_OFF_T_FORMAT",\"blocks\":%lu",
+		               line,
+		               i ? "," : "",
+		               mx.chans[i].bytes,
+		               mx.chans[i].blocks);
+		if (mx.chans[i].blocks && mx.chans[i].stripe >= 0)
+			line = Sprintf(line, "%s,\"stripe\":%d", line, mx.chans[i].stripe);
+		line = Sprintf(line, "%s}", line);
+
+		if (mx.chans[i].blocks && mx.chans[i].stripe >= scnt)
+			scnt = mx.chans[i].stripe + 1;
+	}
+	line = Sprintf(line, "%s]", line);
+
+	/* Totals per stripe of a striped server. */
+	if (scnt > 1)
+	{
+		sum = (mxc_t *) malloc(sizeof(mxc_t) * scnt);
+		memset(sum, 0, sizeof(mxc_t) * scnt);
+		for (i = 0; i < mx.chancnt; i++)
+		{
+			if (!mx.chans[i].blocks || mx.chans[i].stripe < 0)
+				continue;
+			sum[mx.chans[i].stripe].bytes  += mx.chans[i].bytes;
+			sum[mx.chans[i].stripe].blocks += mx.chans[i].blocks;
+		}
+
+		line = Sprintf(line, "%s,\"stripes\":[", line);
+		for (s = 0; s < scnt; s++)
+			line = Sprintf(line,
+			               "%s%s{\"bytes\":%"GLOBUS_OFF_T_FORMAT
+			               ",\"blocks\":%lu,\"rate\":%.0f}",
+			               line,
+			               s ? "," : "",
+			               sum[s].bytes,
+			               sum[s].blocks,
+			               usec ? sum[s].bytes * 1000000.0 / usec : 0.0);
+		line = Sprintf(line, "%s]", line);
+		FREE(sum);
+	}
+	line = Sprintf(line, "%s}\n", line);
+
+	/*
+	 * One write() per record keeps lines from concurrent transfer workers
+	 * from interleaving.
+	 */
+	fd = open(s_metrics(), O_WRONLY|O_APPEND|O_CREAT, S_IRUSR|S_IWUSR);
+	if (fd == -1 || write(fd, line, strlen(line)) != strlen(line))
+		o_fprintf(stderr,
+		          DEBUG_ERRS_ONLY,
+		          "Failed to write metrics to %s: %s\n",
+		          s_metrics(),
+		          strerror(errno));
+	if (fd != -1)
+		close(fd);
+
+	FREE(line);
+	FREE(mx.src);
+	FREE(mx.dst);
+	FREE(mx.chans);
+	mx.chancnt = 0;
+}
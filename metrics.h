@@ -0,0 +1,102 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef UBER_METRICS_H
+#define UBER_METRICS_H
+
+#include <sys/time.h>
+#include <sys/types.h>
+
+/*
+ * Per transfer instrumentation. _c_xfer_file() brackets each file with
+ * mx_start() and mx_finish(); the layers in between add the time they spend
+ * blocked. When the metrics setting names a file, mx_finish() appends one
+ * JSON object per transfer to it. With metrics off, every call returns
+ * without reading the clock.
+ *
+ * There is one transfer in flight per process. A helper thread (the
+ * pipeline reader) calls mx_defer() so that its counts go to a private
+ * mx_t; it passes those to the transfer's thread with mx_take(), which
+ * folds them in with mx_merge(). So no locking is done.
+ */
+
+typedef struct _mx mx_t;
+
+#define MX_READ       0 /* Blocked waiting for the source. */
+#define MX_WRITE      1 /* Blocked waiting for the destination. */
+#define MX_EB_POLL    2 /* Driving the extended block channels. */
+#define MX_GSS_WRAP   3 /* gss_wrap() on the data channel. */
+#define MX_GSS_UNWRAP 4 /* gss_unwrap() on the data channel. */
+#define MX_TIMERS     5
+
+void mx_start(char * src, char * dst);
+void mx_finish(int success);
+
+/* Note a retry of the current transfer. */
+void mx_retry(void);
+
+/* Note that the transfer used the zero copy path. */
+void mx_zcopy(void);
+
+/* Count bytes that reached the destination. */
+void mx_bytes(size_t len);
+
+/*
+ * Count a block on extended block data channel chan, which talks to stripe
+ * (-1 if not known).
+ */
+void mx_chan(int chan, int stripe, size_t len);
+
+/* Start a timer. */
+void mx_now(struct timeval * tv);
+
+/* Add the time since mx_now(tv) to timer which. */
+void mx_add(int which, struct timeval * tv);
+
+/* Count this thread's metrics apart until they are taken. */
+void mx_defer(void);
+
+/* Take what this thread has counted so far; NULL if nothing to merge. */
+mx_t * mx_take(void);
+
+/* Add m to the current transfer and free it. */
+void mx_merge(mx_t * m);
+
+#endif /* UBER_METRICS_H */
@@ -813,3 +813,11 @@ MkRate(struct timeval * start, struct timeval * stop, globus_off_t bytes)
 
 	return Sprintf(NULL, "%.3lf B/s", rate);
 }
+
+unsigned long long
+Fnv1a(unsigned long long hash, char * buf, size_t len)
+{
+	while (len--)
+		hash = (hash ^ (unsigned char)*buf++) * 1099511628211ULL;
+	return hash;
+}
@@ -145,4 +145,10 @@ Convtime(struct timeval * start, struct timeval * stop);
 char *
 MkRate(struct timeval * start, struct timeval * stop, globus_off_t size);
 
+/* FNV-1a. Start with FNV1A_BASIS; pass the result back in to continue. */
+#define FNV1A_BASIS 14695981039346656037ULL
+
+unsigned long long
+Fnv1a(unsigned long long hash, char * buf, size_t len);
+
 #endif /* UBER_MISC_H */
@@ -280,6 +280,14 @@ const Linterface_t NcInterface = {
 	nc_utime,
 	nc_lscos,
 	nc_lsfam,
+	NULL, /* detach */
+	NULL, /* fileno */
+	NULL, /* zcopy */
+	NULL, /* sendfile */
+	NULL, /* recvfile */
+	NULL, /* url */
+	NULL, /* lost */
+	NULL, /* interrupt */
 #ifdef SYSLOG_PERF
 	nc_rhost,
 #endif /* SYSLOG_PERF */
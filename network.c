@@ -38,17 +38,45 @@
  * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
  * DEALINGS WITH THE SOFTWARE.
  */
+
+#ifdef __linux__
+#define _GNU_SOURCE /* splice(), F_SETPIPE_SZ */
+#endif /* __linux__ */
+
+#include "config.h"
+
 #include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/poll.h>
+#include <sys/time.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <netdb.h>
 #include <fcntl.h>
 
+#ifdef __linux__
+#include <linux/sockios.h> /* SIOCOUTQ */
+#include <linux/errqueue.h> /* MSG_ZEROCOPY completions */
+#endif /* __linux__ */
+
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define NET_ZEROCOPY
+#endif /* SO_ZEROCOPY && MSG_ZEROCOPY && SO_EE_ORIGIN_ZEROCOPY */
+
+#if defined(HAVE_SENDFILE) && defined(HAVE_SPLICE)
+#include <sys/sendfile.h>
+#endif /* HAVE_SENDFILE && HAVE_SPLICE */
+
+#ifdef HAVE_EPOLL_CREATE1
+#include <sys/epoll.h>
+#endif /* HAVE_EPOLL_CREATE1 */
+
 #include "settings.h"
 #include "errcode.h"
 #include "network.h"
@@ -68,9 +96,67 @@ struct network_handle_t
 {
 	int fd;
 	int state;
+	int piped;  /* 1 if pfd is open for net_splice_in(). */
+	int pfd[2];
+	nr_t * nr;   /* Reactor this handle is registered with. */
+	int events;  /* NET_POLL_* registered with nr. */
+	int revents; /* NET_POLL_* ready after the last nr_wait(). */
+	int zc;      /* SO_ZEROCOPY: 0 untried, 1 on, -1 unavailable. */
+	unsigned int zcnext; /* Id of the next zero copy send. */
+	unsigned int zcdone; /* Zero copy sends before this id are complete. */
+	int zcsent;  /* 1 once a zero copy send has been numbered. */
 };
 
-static errcode_t _net_wait_ready(nh_t * nh, int read, int write, int except);
+/* Most events taken from the kernel per nr_wait(). */
+#define NR_EVENTS 32
+
+/*
+ * Longest net_sendfile() and net_splice_in() wait for the socket, so that
+ * the caller gets back to the control channel.
+ */
+#define NET_ZC_WAIT 1000
+
+static errcode_t _net_wait_ready(nh_t * nh, 
+                                 int    read, 
+                                 int    write, 
+                                 int    except,
+                                 int    timeout,
+                                 int  * ready);
+static void _net_set_tcp(int fd, int wsize);
+static void _nr_forget(nh_t * nh);
+
+/*
+ * Apply the TCP buffer size (0 for the system default) and the congestion
+ * control setting to a socket before it connects or listens. Both are
+ * hints; the kernel may clamp the buffers and refuse an algorithm it does
+ * not have, which leaves its own default in place.
+ */
+static void
+_net_set_tcp(int fd, int wsize)
+{
+	if (wsize)
+	{
+		setsockopt(fd, 
+		           SOL_SOCKET, 
+		           SO_SNDBUF, 
+		           (char *) &wsize, 
+		           sizeof(wsize));
+		setsockopt(fd, 
+		           SOL_SOCKET, 
+		           SO_RCVBUF, 
+		           (char *) &wsize, 
+		           sizeof(wsize));
+	}
+
+#ifdef TCP_CONGESTION
+	if (s_congestion())
+		setsockopt(fd,
+		           IPPROTO_TCP,
+		           TCP_CONGESTION,
+		           s_congestion(),
+		           strlen(s_congestion()));
+#endif /* TCP_CONGESTION */
+}
 
 static errcode_t
 _net_set_nonblocking(int fd)
@@ -115,10 +201,9 @@ net_connected(nh_t * nh)
 }
 
 errcode_t
-net_connect(nh_t ** nhp,  struct sockaddr_in * sin)
+net_connect(nh_t ** nhp,  struct sockaddr_in * sin, int wsize)
 {
 	int             rval            = 0;
-	int             wsize           = 0;
 	int             have_port_range = 0;
 	nh_t          * nh              = NULL;
 	errcode_t       ec              = EC_SUCCESS;
@@ -163,21 +248,7 @@ net_connect(nh_t ** nhp,  struct sockaddr_in * sin)
 		}
 
 		/* Set our TCP buffer write sisze. */
-		wsize = s_tcpbuf();
-		if (wsize)
-		{
-			setsockopt(nh->fd, 
-			           SOL_SOCKET, 
-			           SO_SNDBUF, 
-			           (char *) &wsize, 
-			           sizeof(wsize));
-			setsockopt(nh->fd, 
-			           SOL_SOCKET, 
-			           SO_RCVBUF, 
-			           (char *) &wsize, 
-			           sizeof(wsize));
-
-		}
+		_net_set_tcp(nh->fd, wsize);
 
 		/* Set the socket to non blocking. */
 		ec = _net_set_nonblocking(nh->fd);
@@ -271,10 +342,9 @@ cleanup:
 }
 
 errcode_t
-net_listen(nh_t ** nhp, struct sockaddr_in * sin)
+net_listen(nh_t ** nhp, struct sockaddr_in * sin, int wsize)
 {
 	int             rval    = 0;
-	int             wsize   = 0;
 	nh_t          * nh      = NULL;
 	errcode_t       ec      = EC_SUCCESS;
 	unsigned short  port    = 0;
@@ -295,21 +365,8 @@ net_listen(nh_t ** nhp, struct sockaddr_in * sin)
 		goto cleanup;
 	}
 
-	wsize = s_tcpbuf();
-	if (wsize)
-	{
-		setsockopt(nh->fd, 
-		           SOL_SOCKET, 
-		           SO_SNDBUF, 
-		           (char *) &wsize, 
-		           sizeof(wsize));
-		setsockopt(nh->fd, 
-		           SOL_SOCKET, 
-		           SO_RCVBUF, 
-		           (char *) &wsize, 
-		           sizeof(wsize));
-
-	}
+	/* Accepted connections inherit these. */
+	_net_set_tcp(nh->fd, wsize);
 
 	ec = _net_set_nonblocking(nh->fd);
 	if (ec != EC_SUCCESS)
@@ -416,6 +473,7 @@ net_accept(nh_t * nh, nh_t ** nhp)
 	}
 
 	*nhp = (nh_t *) malloc(sizeof(nh_t));
+	memset(*nhp, 0, sizeof(nh_t));
 	(*nhp)->fd = rval;
 	(*nhp)->state = NET_STATE_CONNECTED;
 
@@ -428,6 +486,15 @@ net_close(nh_t * nh)
 	if (!nh)
 		return;
 
+	if (nh->piped)
+	{
+		close(nh->pfd[0]);
+		close(nh->pfd[1]);
+		nh->piped = 0;
+	}
+
+	_nr_forget(nh);
+
 	if (nh->state == NET_STATE_CLOSED)
 		return;
 
@@ -457,7 +524,7 @@ net_read(nh_t * nh, char * buf, size_t * count, int * eof)
 /*
 	if (nh->state == NET_STATE_CONNECTING)
 	{
-		ec = _net_wait_ready(nh, 1, 0, 0);
+		ec = _net_wait_ready(nh, 1, 0, 0, -1, NULL);
 		if (ec != EC_SUCCESS)
 			return ec;
 	}
@@ -498,7 +565,7 @@ net_write(nh_t * nh, char * buf, size_t count)
 
 	while (count > off)
 	{
-		ec = _net_wait_ready(nh, 0, 1, 0);
+		ec = _net_wait_ready(nh, 0, 1, 0, -1, NULL);
 		if (ec != EC_SUCCESS)
 			return ec;
 
@@ -541,6 +608,326 @@ net_write_nb(nh_t * nh, char * buf, size_t * count)
 	return ec;
 }
 
+errcode_t
+net_writev_nb(nh_t * nh, struct iovec * iov, int iovcnt, size_t * count)
+{
+	errcode_t ec  = EC_SUCCESS;
+	ssize_t   cnt = 0;
+
+	cnt = writev(nh->fd, iov, iovcnt);
+	if (cnt == -1 && errno != EINTR && errno != EAGAIN)
+	{
+		return ec_create(EC_GSI_SUCCESS,
+		                 EC_GSI_SUCCESS,
+		                 "writev() failed: %s",
+		                 strerror(errno));
+	}
+
+	if (cnt > 0)
+		*count -= cnt;
+
+	return ec;
+}
+
+int
+net_zc_enable(nh_t * nh)
+{
+#ifdef NET_ZEROCOPY
+	int on = 1;
+
+	if (nh->zc == 0)
+	{
+		nh->zc = -1;
+		if (setsockopt(nh->fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0)
+			nh->zc = 1;
+	}
+#endif /* NET_ZEROCOPY */
+
+	return nh->zc == 1;
+}
+
+errcode_t
+net_write_zc(nh_t         * nh,
+             struct iovec * iov,
+             int            iovcnt,
+             size_t       * count,
+             unsigned int * id)
+{
+#ifdef NET_ZEROCOPY
+	ssize_t       cnt = 0;
+	struct msghdr msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov    = iov;
+	msg.msg_iovlen = iovcnt;
+
+	cnt = sendmsg(nh->fd, &msg, MSG_ZEROCOPY);
+	if (cnt == -1 && errno == ENOBUFS)
+	{
+		/* Out of optmem for notifications; this one goes by copy. */
+		return net_writev_nb(nh, iov, iovcnt, count);
+	}
+	if (cnt == -1 && errno != EINTR && errno != EAGAIN)
+	{
+		return ec_create(EC_GSI_SUCCESS,
+		                 EC_GSI_SUCCESS,
+		                 "sendmsg() failed: %s",
+		                 strerror(errno));
+	}
+
+	/* The kernel only numbers sends that queued data. */
+	if (cnt > 0)
+	{
+		*count -= cnt;
+		*id = nh->zcnext++;
+		nh->zcsent = 1;
+	}
+
+	return EC_SUCCESS;
+#else /* NET_ZEROCOPY */
+	return net_writev_nb(nh, iov, iovcnt, count);
+#endif /* NET_ZEROCOPY */
+}
+
+#ifdef NET_ZEROCOPY
+/* Collect completions from the error queue. */
+static void
+_net_zc_reap(nh_t * nh)
+{
+	char                       control[128];
+	struct msghdr              msg;
+	struct cmsghdr           * cm   = NULL;
+	struct sock_extended_err * serr = NULL;
+
+	while (1)
+	{
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control    = control;
+		msg.msg_controllen = sizeof(control);
+
+		if (recvmsg(nh->fd, &msg, MSG_ERRQUEUE|MSG_DONTWAIT) == -1)
+			break;
+
+		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+		{
+			serr = (struct sock_extended_err *) CMSG_DATA(cm);
+			if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno)
+				continue;
+
+			/* Sends ee_info through ee_data are done. TCP finishes in order. */
+			if ((int)(serr->ee_data + 1 - nh->zcdone) > 0)
+				nh->zcdone = serr->ee_data + 1;
+
+			/*
+			 * The device could not send from our pages and the kernel
+			 * copied anyway. Stop paying for notifications.
+			 */
+			if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				nh->zc = -1;
+		}
+	}
+}
+#endif /* NET_ZEROCOPY */
+
+/*
+ * Completions keep an error raised on the socket until they are read, so
+ * read them whenever the socket reports one.
+ */
+static void
+_net_zc_drain(nh_t * nh)
+{
+#ifdef NET_ZEROCOPY
+	if (nh->zcsent)
+		_net_zc_reap(nh);
+#endif /* NET_ZEROCOPY */
+}
+
+int
+net_zc_done(nh_t * nh, unsigned int id, int timeout)
+{
+#ifdef NET_ZEROCOPY
+	int            rval = 0;
+	long long      left = timeout;
+	struct pollfd  ufd;
+	struct timeval start;
+	struct timeval now;
+
+	/* Every send went by copy, so there is nothing to wait for. */
+	if (!nh->zcsent)
+		return 1;
+
+	gettimeofday(&start, NULL);
+
+	while (1)
+	{
+		_net_zc_reap(nh);
+		if ((int)(id - nh->zcdone) < 0)
+			return 1;
+
+		if (timeout >= 0)
+		{
+			gettimeofday(&now, NULL);
+			left = timeout - ((long long)(now.tv_sec - start.tv_sec) * 1000 +
+			                  (now.tv_usec - start.tv_usec) / 1000);
+			if (left <= 0)
+				return 0;
+		}
+
+		/* Completions arrive as POLLERR, which needs no events. */
+		ufd.fd      = nh->fd;
+		ufd.events  = 0;
+		ufd.revents = 0;
+		rval = poll(&ufd, 1, (int) left);
+		if (rval == -1 && errno != EINTR)
+			return 0;
+	}
+#else /* NET_ZEROCOPY */
+	return 1;
+#endif /* NET_ZEROCOPY */
+}
+
+#if defined(HAVE_SENDFILE) && defined(HAVE_SPLICE)
+errcode_t
+net_sendfile(nh_t * nh, int fd, off_t off, size_t * count, int * eof)
+{
+	errcode_t ec    = EC_SUCCESS;
+	ssize_t   cnt   = 0;
+	int       ready = 0;
+
+	*eof = 0;
+
+	ec = _net_wait_ready(nh, 0, 1, 0, NET_ZC_WAIT, &ready);
+	if (ec != EC_SUCCESS || !ready)
+	{
+		*count = 0;
+		return ec;
+	}
+
+	cnt = sendfile(nh->fd, fd, &off, *count);
+
+	if (cnt == -1 && (errno == EAGAIN || errno == EINTR))
+	{
+		*count = 0;
+		return ec;
+	}
+
+	if (cnt == -1)
+	{
+		net_close(nh);
+		return ec_create(EC_GSI_SUCCESS,
+		                 EC_GSI_SUCCESS,
+		                 "sendfile() failed: %s",
+		                 strerror(errno));
+	}
+
+	*count = cnt;
+	if (cnt == 0)
+		*eof = 1;
+
+	return ec;
+}
+
+errcode_t
+net_splice_in(nh_t * nh, int fd, off_t off, size_t * count, int * eof)
+{
+	errcode_t ec   = EC_SUCCESS;
+	ssize_t   cnt  = 0;
+	ssize_t   rval  = 0;
+	ssize_t   left  = 0;
+	int       ready = 0;
+
+	*eof = 0;
+
+	/*
+	 * splice() needs a pipe on one side, so bytes go socket -> pipe -> file.
+	 * The pipe lives with the handle so it is only created once per data
+	 * channel. Growing it to the block size lets one call move a full block.
+	 */
+	if (!nh->piped)
+	{
+		if (pipe(nh->pfd) == -1)
+			return ec_create(EC_GSI_SUCCESS,
+			                 EC_GSI_SUCCESS,
+			                 "pipe() failed: %s",
+			                 strerror(errno));
+		nh->piped = 1;
+#ifdef F_SETPIPE_SZ
+		fcntl(nh->pfd[1], F_SETPIPE_SZ, s_blocksize());
+#endif /* F_SETPIPE_SZ */
+	}
+
+	ec = _net_wait_ready(nh, 1, 0, 0, NET_ZC_WAIT, &ready);
+	if (ec != EC_SUCCESS || !ready)
+	{
+		*count = 0;
+		return ec;
+	}
+
+	cnt = splice(nh->fd,
+	             NULL,
+	             nh->pfd[1],
+	             NULL,
+	             *count,
+	             SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+
+	if (cnt == -1 && (errno == EAGAIN || errno == EINTR))
+	{
+		*count = 0;
+		return ec;
+	}
+
+	if (cnt == -1)
+		return ec_create(EC_GSI_SUCCESS,
+		                 EC_GSI_SUCCESS,
+		                 "splice() failed: %s",
+		                 strerror(errno));
+
+	*count = cnt;
+	if (cnt == 0)
+	{
+		*eof = 1;
+		nh->state = NET_STATE_CLOSING;
+		return ec;
+	}
+
+	/* Empty the pipe into the file. */
+	for (left = cnt; left > 0; left -= rval)
+	{
+		rval = splice(nh->pfd[0], NULL, fd, &off, left, SPLICE_F_MOVE);
+
+		if (rval == -1 && errno == EINTR)
+		{
+			rval = 0;
+			continue;
+		}
+
+		if (rval <= 0)
+			return ec_create(EC_GSI_SUCCESS,
+			                 EC_GSI_SUCCESS,
+			                 "splice() failed: %s",
+			                 rval ? strerror(errno) : "short write");
+	}
+
+	return ec;
+}
+#endif /* HAVE_SENDFILE && HAVE_SPLICE */
+
+int
+net_unsent(nh_t * nh)
+{
+	int unsent = 0;
+
+#if defined(SIOCOUTQ)
+	if (ioctl(nh->fd, SIOCOUTQ, &unsent) == 0)
+		return unsent;
+#elif defined(FIONWRITE)
+	if (ioctl(nh->fd, FIONWRITE, &unsent) == 0)
+		return unsent;
+#endif /* SIOCOUTQ */
+
+	return -1;
+}
+
 errcode_t
 net_wait(nh_t * nh1, nh_t * nh2, int timeout)
 {
@@ -628,6 +1015,377 @@ net_poll(nh_t * nh, int * read, int * write, int timeout)
 	return EC_SUCCESS;
 }
 
+/*
+ * The reactor keeps each handle's interest registered between waits so a
+ * wait costs one system call no matter how many channels are open. With
+ * epoll the registration lives in the kernel; elsewhere poll() is run over
+ * the registered handles.
+ */
+struct net_reactor_t
+{
+	int             epfd;  /* -1 when falling back to poll(). */
+	nh_t         ** nhs;   /* Registered handles. */
+	int             cnt;
+	int             max;
+	struct timeval  timers[NR_TIMERS]; /* Deadlines, tv_sec 0 if unarmed. */
+	int             fired; /* Bit per timer that has expired. */
+};
+
+#ifdef HAVE_EPOLL_CREATE1
+static int
+_nr_epoll_events(int events)
+{
+	int ev = 0;
+
+	if (events & NET_POLL_READ)
+		ev |= EPOLLIN;
+	if (events & NET_POLL_WRITE)
+		ev |= EPOLLOUT;
+	return ev;
+}
+#endif /* HAVE_EPOLL_CREATE1 */
+
+/* Drop nh from its reactor. */
+static void
+_nr_forget(nh_t * nh)
+{
+	nr_t * nr = nh->nr;
+	int    i  = 0;
+
+	if (!nr)
+		return;
+
+#ifdef HAVE_EPOLL_CREATE1
+	if (nr->epfd != -1 && nh->fd != -1 && nh->state != NET_STATE_CLOSED)
+		epoll_ctl(nr->epfd, EPOLL_CTL_DEL, nh->fd, NULL);
+#endif /* HAVE_EPOLL_CREATE1 */
+
+	for (i = 0; i < nr->cnt; i++)
+	{
+		if (nr->nhs[i] == nh)
+		{
+			nr->nhs[i] = nr->nhs[--nr->cnt];
+			break;
+		}
+	}
+
+	nh->nr      = NULL;
+	nh->events  = 0;
+	nh->revents = 0;
+}
+
+errcode_t
+nr_init(nr_t ** nrp)
+{
+	nr_t * nr = NULL;
+
+	*nrp = nr = (nr_t *) malloc(sizeof(nr_t));
+	memset(nr, 0, sizeof(nr_t));
+	nr->epfd = -1;
+
+#ifdef HAVE_EPOLL_CREATE1
+	/* poll() still works if the kernel is out of epoll instances. */
+	nr->epfd = epoll_create1(EPOLL_CLOEXEC);
+#endif /* HAVE_EPOLL_CREATE1 */
+
+	return EC_SUCCESS;
+}
+
+void
+nr_destroy(nr_t * nr)
+{
+	if (!nr)
+		return;
+
+	while (nr->cnt)
+		_nr_forget(nr->nhs[0]);
+
+	if (nr->epfd != -1)
+		close(nr->epfd);
+
+	FREE(nr->nhs);
+	FREE(nr);
+}
+
+errcode_t
+nr_watch(nr_t * nr, nh_t * nh, int events)
+{
+#ifdef HAVE_EPOLL_CREATE1
+	int                rval = 0;
+	int                op   = EPOLL_CTL_MOD;
+	struct epoll_event ev;
+#endif /* HAVE_EPOLL_CREATE1 */
+
+	if (nh->nr != nr)
+	{
+		_nr_forget(nh);
+
+		if (nr->cnt == nr->max)
+		{
+			nr->max = nr->max ? nr->max * 2 : 8;
+			nr->nhs = (nh_t **) realloc(nr->nhs, sizeof(nh_t *) * nr->max);
+		}
+		nr->nhs[nr->cnt++] = nh;
+		nh->nr     = nr;
+		nh->events = -1;
+#ifdef HAVE_EPOLL_CREATE1
+		op = EPOLL_CTL_ADD;
+#endif /* HAVE_EPOLL_CREATE1 */
+	}
+
+	/* Most waits ask for what they asked for last time. */
+	if (nh->events == events)
+		return EC_SUCCESS;
+
+#ifdef HAVE_EPOLL_CREATE1
+	/* An idle handle was removed from the set below; put it back. */
+	if (nh->events == 0)
+		op = EPOLL_CTL_ADD;
+#endif /* HAVE_EPOLL_CREATE1 */
+	nh->events = events;
+
+#ifdef HAVE_EPOLL_CREATE1
+	if (nr->epfd == -1 || nh->fd == -1 || nh->state == NET_STATE_CLOSED)
+		return EC_SUCCESS;
+
+	/*
+	 * epoll reports errors and hangups whether asked or not, so an idle
+	 * handle whose peer went away would wake every wait. Idle handles stay
+	 * out of the set.
+	 */
+	if (!events)
+	{
+		if (op == EPOLL_CTL_MOD)
+			epoll_ctl(nr->epfd, EPOLL_CTL_DEL, nh->fd, NULL);
+		return EC_SUCCESS;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events   = _nr_epoll_events(events);
+	ev.data.ptr = nh;
+
+	rval = epoll_ctl(nr->epfd, op, nh->fd, &ev);
+	if (rval == -1 && op == EPOLL_CTL_MOD && errno == ENOENT)
+		rval = epoll_ctl(nr->epfd, EPOLL_CTL_ADD, nh->fd, &ev);
+	if (rval == -1 && op == EPOLL_CTL_ADD && errno == EEXIST)
+		rval = epoll_ctl(nr->epfd, EPOLL_CTL_MOD, nh->fd, &ev);
+	if (rval == -1)
+		return ec_create(EC_GSI_SUCCESS,
+		                 EC_GSI_SUCCESS,
+		                 "epoll_ctl() failed: %s",
+		                 strerror(errno));
+#endif /* HAVE_EPOLL_CREATE1 */
+
+	return EC_SUCCESS;
+}
+
+int
+net_ready(nh_t * nh)
+{
+	return nh ? nh->revents : 0;
+}
+
+void
+nr_timer(nr_t * nr, int id, int ms)
+{
+	nr->fired &= ~(1 << id);
+	nr->timers[id].tv_sec  = 0;
+	nr->timers[id].tv_usec = 0;
+
+	if (ms <= 0)
+		return;
+
+	gettimeofday(&nr->timers[id], NULL);
+	nr->timers[id].tv_sec  += ms / 1000;
+	nr->timers[id].tv_usec += (ms % 1000) * 1000;
+	if (nr->timers[id].tv_usec >= 1000000)
+	{
+		nr->timers[id].tv_sec++;
+		nr->timers[id].tv_usec -= 1000000;
+	}
+}
+
+int
+nr_armed(nr_t * nr, int id)
+{
+	return nr->timers[id].tv_sec != 0;
+}
+
+int
+nr_expired(nr_t * nr, int id)
+{
+	if (!(nr->fired & (1 << id)))
+		return 0;
+
+	nr->fired &= ~(1 << id);
+	return 1;
+}
+
+/* Shorten timeout to the nearest armed timer. */
+static int
+_nr_timeout(nr_t * nr, int timeout)
+{
+	int            i  = 0;
+	long long      ms = 0;
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	for (i = 0; i < NR_TIMERS; i++)
+	{
+		if (!nr->timers[i].tv_sec)
+			continue;
+
+		ms = (long long)(nr->timers[i].tv_sec - now.tv_sec) * 1000 +
+		     (nr->timers[i].tv_usec - now.tv_usec + 999) / 1000;
+		if (ms < 0)
+			ms = 0;
+		if (timeout < 0 || ms < timeout)
+			timeout = (int) ms;
+	}
+	return timeout;
+}
+
+/* Mark the timers whose deadline has passed. */
+static void
+_nr_fire(nr_t * nr)
+{
+	int            i = 0;
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	for (i = 0; i < NR_TIMERS; i++)
+	{
+		if (!nr->timers[i].tv_sec)
+			continue;
+
+		if (timercmp(&now, &nr->timers[i], <))
+			continue;
+
+		nr->timers[i].tv_sec  = 0;
+		nr->timers[i].tv_usec = 0;
+		nr->fired |= 1 << i;
+	}
+}
+
+errcode_t
+nr_wait(nr_t * nr, int timeout)
+{
+	int             i    = 0;
+	int             rval = 0;
+	nh_t          * nh   = NULL;
+	struct pollfd * ufds = NULL;
+#ifdef HAVE_EPOLL_CREATE1
+	int             ev   = 0;
+	struct epoll_event evs[NR_EVENTS];
+#endif /* HAVE_EPOLL_CREATE1 */
+
+	for (i = 0; i < nr->cnt; i++)
+		nr->nhs[i]->revents = 0;
+
+	timeout = _nr_timeout(nr, timeout);
+
+#ifdef HAVE_EPOLL_CREATE1
+	if (nr->epfd != -1)
+	{
+		do {
+			rval = epoll_wait(nr->epfd, evs, NR_EVENTS, timeout);
+		} while (rval == -1 && errno == EINTR);
+
+		if (rval == -1)
+			return ec_create(EC_GSI_SUCCESS,
+			                 EC_GSI_SUCCESS,
+			                 "epoll_wait() failed: %s",
+			                 strerror(errno));
+
+		for (i = 0; i < rval; i++)
+		{
+			nh = (nh_t *) evs[i].data.ptr;
+			ev = evs[i].events;
+
+			/* Errors and hangups wake whatever the caller waits on. */
+			if (ev & (EPOLLERR|EPOLLHUP))
+				nh->revents = nh->events;
+			if (ev & EPOLLERR)
+				_net_zc_drain(nh);
+			if (ev & EPOLLIN)
+				nh->revents |= NET_POLL_READ;
+			if (ev & EPOLLOUT)
+				nh->revents |= NET_POLL_WRITE;
+		}
+
+		_nr_fire(nr);
+		return EC_SUCCESS;
+	}
+#endif /* HAVE_EPOLL_CREATE1 */
+
+	ufds = (struct pollfd *) malloc(sizeof(struct pollfd) * (nr->cnt + 1));
+
+	for (i = 0; i < nr->cnt; i++)
+	{
+		nh = nr->nhs[i];
+		ufds[i].fd      = -1;
+		ufds[i].events  = 0;
+		ufds[i].revents = 0;
+
+		if (nh->events <= 0 || nh->fd == -1 || nh->state == NET_STATE_CLOSED)
+			continue;
+
+		ufds[i].fd = nh->fd;
+		if (nh->events & NET_POLL_READ)
+			ufds[i].events |= POLLIN;
+		if (nh->events & NET_POLL_WRITE)
+			ufds[i].events |= POLLOUT;
+	}
+
+	do {
+		rval = poll(ufds, nr->cnt, timeout);
+	} while (rval == -1 && errno == EINTR);
+
+	if (rval == -1)
+	{
+		FREE(ufds);
+		return ec_create(EC_GSI_SUCCESS,
+		                 EC_GSI_SUCCESS,
+		                 "poll() failed: %s",
+		                 strerror(errno));
+	}
+
+	for (i = 0; i < nr->cnt; i++)
+	{
+		nh = nr->nhs[i];
+		if (ufds[i].revents & (POLLERR|POLLHUP|POLLNVAL))
+			nh->revents = nh->events;
+		if (ufds[i].revents & POLLERR)
+			_net_zc_drain(nh);
+		if (ufds[i].revents & POLLIN)
+			nh->revents |= NET_POLL_READ;
+		if (ufds[i].revents & POLLOUT)
+			nh->revents |= NET_POLL_WRITE;
+	}
+
+	FREE(ufds);
+	_nr_fire(nr);
+	return EC_SUCCESS;
+}
+
+long long
+net_rtt(nh_t * nh)
+{
+#ifdef TCP_INFO
+	struct tcp_info ti;
+	socklen_t       len = sizeof(ti);
+
+	if (!nh || nh->fd == -1 || nh->state != NET_STATE_CONNECTED)
+		return 0;
+
+	memset(&ti, 0, sizeof(ti));
+	if (getsockopt(nh->fd, IPPROTO_TCP, TCP_INFO, &ti, &len) == 0)
+		return ti.tcpi_rtt;
+#endif /* TCP_INFO */
+
+	return 0;
+}
+
 errcode_t
 net_getsockname(nh_t * nh, struct sockaddr_in * sin)
 {
@@ -678,15 +1436,28 @@ cleanup:
 	return ec;
 }
 
+/*
+ * Wait up to timeout milliseconds (-1 for as long as it takes) for nh.
+ * *ready, if given, is 0 if the time ran out.
+ */
 static errcode_t
-_net_wait_ready(nh_t * nh, int read, int write, int except)
+_net_wait_ready(nh_t * nh, 
+                int    read, 
+                int    write, 
+                int    except,
+                int    timeout,
+                int  * ready)
 {
 	int rval = 0;
 	fd_set rset;
 	fd_set wset;
 	fd_set eset;
+	struct timeval tv;
 
 	do {
+		tv.tv_sec  = timeout / 1000;
+		tv.tv_usec = (timeout % 1000) * 1000;
+
 		FD_ZERO(&rset);
 		FD_ZERO(&wset);
 		FD_ZERO(&eset);
@@ -699,8 +1470,8 @@ _net_wait_ready(nh_t * nh, int read, int write, int except)
 		              read   ? &rset : NULL, 
 		              write  ? &wset : NULL, 
 		              except ? &eset : NULL, 
-		              NULL);
-	} while (rval == 0 || (rval == -1 && errno == EINTR));
+		              timeout < 0 ? NULL : &tv);
+	} while ((rval == 0 && timeout < 0) || (rval == -1 && errno == EINTR));
 
 	if (rval == -1)
 		return ec_create(EC_GSI_SUCCESS,
@@ -708,6 +1479,8 @@ _net_wait_ready(nh_t * nh, int read, int write, int except)
 		                 "select() failed: %s",
 		                 strerror(errno));
 
+	if (ready)
+		*ready = rval > 0;
 	return EC_SUCCESS;
 }
 
@@ -42,6 +42,7 @@
 #define UBER_NETWORK_H
 
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "errcode.h"
 
@@ -50,11 +51,12 @@ typedef struct network_handle_t nh_t;
 int
 net_connected(nh_t * nh);
 
+/* wsize is the TCP buffer size, 0 for the system default. */
 errcode_t
-net_connect(nh_t ** nh, struct sockaddr_in *);
+net_connect(nh_t ** nh, struct sockaddr_in *, int wsize);
 
 errcode_t
-net_listen(nh_t ** nhp, struct sockaddr_in * sin);
+net_listen(nh_t ** nhp, struct sockaddr_in * sin, int wsize);
 
 errcode_t
 net_accept(nh_t * nh, nh_t ** nhp);
@@ -74,12 +76,121 @@ net_write(nh_t * nh, char * buf, size_t count);
 errcode_t
 net_write_nb(nh_t * nh, char * buf, size_t * count);
 
+/*
+ * Nonblocking writev(). On entry *count is the total length of iov; on
+ * return it is the number of bytes left unwritten.
+ */
+errcode_t
+net_writev_nb(nh_t * nh, struct iovec * iov, int iovcnt, size_t * count);
+
+/*
+ * Zero copy sends with MSG_ZEROCOPY. net_zc_enable() returns 1 if nh can
+ * send this way; it stops doing so once the kernel reports that it had to
+ * copy anyway. net_write_zc() is net_writev_nb() except the kernel sends
+ * from the caller's pages. If any bytes went out, *id names the send, and
+ * the pages must not be reused until net_zc_done() says that id is
+ * complete. net_zc_done() waits up to timeout milliseconds (-1 forever,
+ * 0 not at all). Without zero copy support, or before any send on nh was
+ * numbered, every send is complete. nr_wait() reads completions whenever
+ * the socket raises an error, so they do not keep it ready.
+ */
+int
+net_zc_enable(nh_t * nh);
+
+errcode_t
+net_write_zc(nh_t         * nh,
+             struct iovec * iov,
+             int            iovcnt,
+             size_t       * count,
+             unsigned int * id);
+
+int
+net_zc_done(nh_t * nh, unsigned int id, int timeout);
+
+/*
+ * Send up to *count bytes of fd, starting at off, straight from the page
+ * cache. *count is set to the number of bytes sent; *eof is set if fd has
+ * nothing left at off. If the socket does not take data within a second,
+ * *count is 0 without eof; call again. Only available with HAVE_SENDFILE
+ * and HAVE_SPLICE.
+ */
+errcode_t
+net_sendfile(nh_t * nh, int fd, off_t off, size_t * count, int * eof);
+
+/*
+ * Move up to *count bytes from the socket into fd at off without copying
+ * them through user space. *count is set to the number of bytes moved; as
+ * with net_sendfile(), it is 0 without eof if nothing arrived in a second.
+ * Only available with HAVE_SENDFILE and HAVE_SPLICE.
+ */
+errcode_t
+net_splice_in(nh_t * nh, int fd, off_t off, size_t * count, int * eof);
+
+/*
+ * Bytes queued in the socket's send buffer that the peer has not yet
+ * acknowledged, or -1 if the platform can not tell us.
+ */
+int
+net_unsent(nh_t * nh);
+
 errcode_t
 net_wait(nh_t * nh1, nh_t * nh2, int timeout);
 
 errcode_t
 net_poll(nh_t * nh, int * read, int * write, int timeout);
 
+#define NET_POLL_READ  0x01
+#define NET_POLL_WRITE 0x02
+
+/*
+ * A reactor waits on many handles at once. Interest is registered once per
+ * handle with nr_watch() and kept between waits (in epoll where available),
+ * so a wait does not rebuild a descriptor set. After nr_wait(), net_ready()
+ * reports what each registered handle is ready for; errors and hangups show
+ * up as whatever the handle was watched for so the next read or write sees
+ * them; idle handles (watched for 0) are not waited on at all. A handle
+ * belongs to at most one reactor and leaves it when closed.
+ *
+ * Timers are numbered 0 to NR_TIMERS-1 by the caller. nr_wait() returns by
+ * the nearest armed deadline and nr_expired() reports each firing once.
+ */
+typedef struct net_reactor_t nr_t;
+
+#define NR_TIMERS 4
+
+errcode_t
+nr_init(nr_t ** nrp);
+
+void
+nr_destroy(nr_t * nr);
+
+/* Set the NET_POLL_* flags nr waits for on nh; 0 leaves nh idle. */
+errcode_t
+nr_watch(nr_t * nr, nh_t * nh, int events);
+
+/* Wait up to timeout milliseconds (-1 forever) for a handle or a timer. */
+errcode_t
+nr_wait(nr_t * nr, int timeout);
+
+/* NET_POLL_* flags nh was ready for after the last nr_wait(). */
+int
+net_ready(nh_t * nh);
+
+/* Arm timer id to fire in ms milliseconds; ms <= 0 disarms it. */
+void
+nr_timer(nr_t * nr, int id, int ms);
+
+int
+nr_armed(nr_t * nr, int id);
+
+/* 1 if timer id fired since it was last checked. */
+int
+nr_expired(nr_t * nr, int id);
+
+/* Smoothed round trip time in microseconds, 0 if the kernel won't say. */
+long long
+net_rtt(nh_t * nh);
+
 errcode_t
 net_getsockname(nh_t * nh, struct sockaddr_in * sin);
 
@@ -41,15 +41,114 @@
 #ifndef UBER_OUTPUT_H
 #define UBER_OUTOUT_H
 
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdio.h>
 
 #include "settings.h"
+#include "output.h"
+#include "misc.h"
 
 #ifdef DMALLOC
 #include "dmalloc.h"
 #endif /* DMALLOC */
 
+struct _od {
+	FILE       * str;
+	char       * msg;
+	size_t       len;
+	struct _od * next;
+};
+
+/* Output held for a thread that called o_defer(). */
+typedef struct {
+	od_t  * head;
+	od_t ** tail;
+} oh_t;
+
+static pthread_key_t  okey;
+static pthread_once_t oonce = PTHREAD_ONCE_INIT;
+
+static void
+_o_release(od_t * od)
+{
+	od_t * next = NULL;
+
+	for (; od; od = next)
+	{
+		next = od->next;
+		FREE(od->msg);
+		FREE(od);
+	}
+}
+
+static void
+_o_free(void * arg)
+{
+	oh_t * oh = (oh_t *) arg;
+
+	if (!oh)
+		return;
+	_o_release(oh->head);
+	FREE(oh);
+}
+
+static void
+_o_key(void)
+{
+	pthread_key_create(&okey, _o_free);
+}
+
+static oh_t *
+_o_held(void)
+{
+	pthread_once(&oonce, _o_key);
+	return (oh_t *) pthread_getspecific(okey);
+}
+
+static void
+_o_hold(oh_t * oh, FILE * str, char * msg, size_t len)
+{
+	od_t * od = NULL;
+
+	od = (od_t *) malloc(sizeof(od_t));
+	od->str  = str;
+	od->msg  = msg;
+	od->len  = len;
+	od->next = NULL;
+
+	*oh->tail = od;
+	oh->tail  = &od->next;
+}
+
+static void
+_o_vfprintf(FILE * str, char * format, va_list ap)
+{
+	oh_t  * oh   = NULL;
+	char  * msg  = NULL;
+	int     ret  = 0;
+	va_list cp;
+
+	oh = _o_held();
+	if (!oh)
+	{
+		vfprintf(str, format, ap);
+		fflush(str);
+		return;
+	}
+
+	va_copy(cp, ap);
+	ret = vsnprintf(NULL, 0, format, cp);
+	va_end(cp);
+	if (ret < 0)
+		return;
+
+	msg = (char *) malloc(ret + 1);
+	vsnprintf(msg, ret + 1, format, ap);
+	_o_hold(oh, str, msg, ret);
+}
 
 void
 o_printf(int dbglvl, char * format, ...)
@@ -60,10 +159,8 @@ o_printf(int dbglvl, char * format, ...)
 		return;
 
 	va_start(ap, format);
-	vfprintf(stdout, format, ap);
+	_o_vfprintf(stdout, format, ap);
 	va_end(ap);
-
-	fflush(stdout);
 }
 
 void
@@ -75,21 +172,74 @@ o_fprintf(FILE * str, int dbglvl, char * format, ...)
 		return;
 
 	va_start(ap, format);
-	vfprintf(str, format, ap);
+	_o_vfprintf(str, format, ap);
 	va_end(ap);
-
-	fflush(str);
 }
 
 void
 o_fwrite(FILE * fptr, int dbglvl, char * str, size_t len)
 {
+	oh_t * oh  = NULL;
+	char * msg = NULL;
+
 	if (dbglvl > s_debug())
 		return;
 
+	oh = _o_held();
+	if (oh)
+	{
+		msg = (char *) malloc(len);
+		memcpy(msg, str, len);
+		_o_hold(oh, fptr, msg, len);
+		return;
+	}
+
 	fwrite(str, sizeof(char), len, fptr);
 
 	fflush(fptr);
 }
 
+void
+o_defer(void)
+{
+	oh_t * oh = NULL;
+
+	if (_o_held())
+		return;
+
+	oh = (oh_t *) malloc(sizeof(oh_t));
+	oh->head = NULL;
+	oh->tail = &oh->head;
+	pthread_setspecific(okey, oh);
+}
+
+od_t *
+o_take(void)
+{
+	oh_t * oh = _o_held();
+	od_t * od = NULL;
+
+	if (!oh)
+		return NULL;
+
+	od = oh->head;
+	oh->head = NULL;
+	oh->tail = &oh->head;
+	return od;
+}
+
+void
+o_flush(od_t * od)
+{
+	od_t * cur = NULL;
+
+	for (cur = od; cur; cur = cur->next)
+	{
+		fwrite(cur->msg, sizeof(char), cur->len, cur->str);
+		fflush(cur->str);
+	}
+
+	_o_release(od);
+}
+
 #endif /* UBER_OUTPUT_H */
@@ -61,4 +61,20 @@ o_fprintf(FILE *, int dbglvl, char * format, ...);
 void
 o_fwrite(FILE *, int dbglvl, char * str, size_t len);
 
+/*
+ * A helper thread (the pipeline reader) must not write to the terminal
+ * itself. After o_defer(), everything it prints is held; o_take() hands
+ * that to another thread, which prints and frees it with o_flush().
+ */
+typedef struct _od od_t;
+
+void
+o_defer(void);
+
+od_t *
+o_take(void);
+
+void
+o_flush(od_t *);
+
 #endif /* UBER_OUTPUT_H */
@@ -0,0 +1,254 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "settings.h"
+#include "pipeline.h"
+#include "errcode.h"
+#include "logical.h"
+#include "metrics.h"
+#include "output.h"
+#include "pool.h"
+#include "misc.h"
+
+#ifdef DMALLOC
+#include "dmalloc.h"
+#endif /* DMALLOC */
+
+/*
+ * The pipeline lets the source and destination of a transfer run at the
+ * same time. A reader thread calls l_read() on the source handle and queues
+ * the blocks in a bounded ring. The caller's thread pulls blocks off of the
+ * ring and hands them to l_write(). Only the reader thread touches the
+ * source handle and only the caller's thread touches the destination
+ * handle, so neither service needs to be thread aware. Third party
+ * transfers are not pipelined since ftp_read() and ftp_write() inspect
+ * the other side's control channel.
+ *
+ * Whatever the source prints or counts while reading a block is held by
+ * the reader (o_defer(), mx_defer()) and travels with the block, so the
+ * caller's thread does all of the printing and metrics. So that
+ * pipeline_destroy() does not wait behind a stalled source, it interrupts
+ * the source with l_interrupt(); the read in progress then fails and the
+ * reader sees the abort.
+ */
+
+typedef struct {
+	char         * buf;
+	globus_off_t   off;
+	size_t         len;
+	int            eof;
+	errcode_t      ec;
+	od_t         * od;
+	mx_t         * mx;
+} plb_t;
+
+struct _pipeline {
+	lh_t            slh;
+	lh_t            dlh;
+	int             threaded;
+	pthread_t       thread;
+	pthread_mutex_t lock;
+	pthread_cond_t  cond;
+	plb_t         * ring;
+	int             depth;
+	int             head;
+	int             cnt;
+	int             abort;
+};
+
+static void *
+_pl_reader(void * arg)
+{
+	pl_t * pl = (pl_t *) arg;
+	plb_t  blk;
+
+	o_defer();
+	mx_defer();
+
+	while (1)
+	{
+		pthread_mutex_lock(&pl->lock);
+		while (pl->cnt == pl->depth && !pl->abort)
+			pthread_cond_wait(&pl->cond, &pl->lock);
+
+		if (pl->abort)
+		{
+			pthread_mutex_unlock(&pl->lock);
+			break;
+		}
+		pthread_mutex_unlock(&pl->lock);
+
+		memset(&blk, 0, sizeof(plb_t));
+		blk.ec = l_read(pl->slh,
+		                pl->dlh,
+		                &blk.buf,
+		                &blk.off,
+		                &blk.len,
+		                &blk.eof);
+		blk.od = o_take();
+		blk.mx = mx_take();
+
+		pthread_mutex_lock(&pl->lock);
+		pl->ring[(pl->head + pl->cnt) % pl->depth] = blk;
+		pl->cnt++;
+		pthread_cond_broadcast(&pl->cond);
+		pthread_mutex_unlock(&pl->lock);
+
+		/* The reader is done on error or eof. */
+		if (blk.ec || blk.eof)
+			break;
+	}
+
+	return NULL;
+}
+
+void
+pipeline_init(pl_t ** plp, lh_t slh, lh_t dlh)
+{
+	int    rc = 0;
+	pl_t * pl = NULL;
+
+	*plp = pl = (pl_t *) malloc(sizeof(pl_t));
+	memset(pl, 0, sizeof(pl_t));
+
+	pl->slh   = slh;
+	pl->dlh   = dlh;
+	pl->depth = s_pipeline();
+
+	if (pl->depth <= 0)
+		return;
+
+	/* Do not pipeline third party transfers. */
+	if (l_is_ftp_service(slh) && l_is_ftp_service(dlh))
+		return;
+
+	pl->ring = (plb_t *) malloc(sizeof(plb_t) * pl->depth);
+	memset(pl->ring, 0, sizeof(plb_t) * pl->depth);
+
+	pthread_mutex_init(&pl->lock, NULL);
+	pthread_cond_init(&pl->cond, NULL);
+
+	rc = pthread_create(&pl->thread, NULL, _pl_reader, pl);
+	if (rc)
+	{
+		/* Fall back to a serialized transfer. */
+		pthread_cond_destroy(&pl->cond);
+		pthread_mutex_destroy(&pl->lock);
+		FREE(pl->ring);
+		return;
+	}
+
+	pl->threaded = 1;
+}
+
+errcode_t
+pipeline_read(pl_t          * pl,
+              char         ** buf,
+              globus_off_t  * off,
+              size_t        * len,
+              int           * eof)
+{
+	plb_t blk;
+
+	if (!pl->threaded)
+		return l_read(pl->slh, pl->dlh, buf, off, len, eof);
+
+	pthread_mutex_lock(&pl->lock);
+	while (pl->cnt == 0)
+		pthread_cond_wait(&pl->cond, &pl->lock);
+
+	blk = pl->ring[pl->head];
+	memset(&pl->ring[pl->head], 0, sizeof(plb_t));
+	pl->head = (pl->head + 1) % pl->depth;
+	pl->cnt--;
+	pthread_cond_broadcast(&pl->cond);
+	pthread_mutex_unlock(&pl->lock);
+
+	o_flush(blk.od);
+	mx_merge(blk.mx);
+
+	*buf = blk.buf;
+	*off = blk.off;
+	*len = blk.len;
+	*eof = blk.eof;
+	return blk.ec;
+}
+
+void
+pipeline_destroy(pl_t * pl)
+{
+	int     i   = 0;
+	plb_t * blk = NULL;
+
+	if (!pl)
+		return;
+
+	if (pl->threaded)
+	{
+		pthread_mutex_lock(&pl->lock);
+		pl->abort = 1;
+		pthread_cond_broadcast(&pl->cond);
+		pthread_mutex_unlock(&pl->lock);
+
+		/* Do not wait for a read from a source that may have stalled. */
+		l_interrupt(pl->slh);
+		pthread_join(pl->thread, NULL);
+
+		/* Release anything the caller did not consume. */
+		for (i = 0; i < pl->cnt; i++)
+		{
+			blk = &pl->ring[(pl->head + i) % pl->depth];
+			o_flush(blk->od);
+			mx_merge(blk->mx);
+			pool_free(blk->buf);
+			ec_destroy(blk->ec);
+		}
+
+		pthread_cond_destroy(&pl->cond);
+		pthread_mutex_destroy(&pl->lock);
+	}
+
+	FREE(pl->ring);
+	FREE(pl);
+}
@@ -0,0 +1,77 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef UBER_PIPELINE_H
+#define UBER_PIPELINE_H
+
+#include <globus_common.h>
+
+#include "errcode.h"
+#include "logical.h"
+
+typedef struct _pipeline pl_t;
+
+/*
+ * Start reading from slh ahead of the caller. Up to s_pipeline() blocks are
+ * kept in flight between the source and the destination. If the transfer
+ * can not be pipelined (third party transfers or pipeline set to 0),
+ * pipeline_read() falls back to calling l_read() directly.
+ */
+void
+pipeline_init(pl_t ** plp, lh_t slh, lh_t dlh);
+
+/*
+ * Same semantics as l_read(). The caller owns the returned buffer.
+ */
+errcode_t
+pipeline_read(pl_t          * pl,
+              char         ** buf,
+              globus_off_t  * off,
+              size_t        * len,
+              int           * eof);
+
+/*
+ * Stop the reader and release any blocks that were not consumed. Must be
+ * called before l_close() on either handle.
+ */
+void
+pipeline_destroy(pl_t * pl);
+
+#endif /* UBER_PIPELINE_H */
@@ -0,0 +1,264 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#include <string.h>
+#include <stdlib.h>
+
+#include <globus_common.h>
+
+#include "output.h"
+#include "plan.h"
+#include "misc.h"
+
+#ifdef DMALLOC
+#include "dmalloc.h"
+#endif /* DMALLOC */
+
+typedef struct {
+	char         * srcurl;
+	char         * dsturl;
+	char         * spath;
+	char         * dpath;
+	globus_off_t   size;
+	int            group; /* Index into the plan's host pairs. */
+	int            order; /* Position in the url file. */
+} pe_t;
+
+/* A source and destination host pair. */
+typedef struct {
+	char * shost;
+	char * dhost;
+} pg_t;
+
+struct _plan {
+	pe_t * ents;
+	int    cnt;
+	int    next;
+	pg_t * groups;
+	int    ngroups;
+};
+
+plan_t *
+plan_init(void)
+{
+	plan_t * pl = (plan_t *) malloc(sizeof(plan_t));
+
+	memset(pl, 0, sizeof(plan_t));
+	return pl;
+}
+
+void
+plan_destroy(plan_t * pl)
+{
+	int i = 0;
+
+	if (!pl)
+		return;
+
+	for (i = 0; i < pl->cnt; i++)
+	{
+		FREE(pl->ents[i].srcurl);
+		FREE(pl->ents[i].dsturl);
+		FREE(pl->ents[i].spath);
+		FREE(pl->ents[i].dpath);
+	}
+
+	for (i = 0; i < pl->ngroups; i++)
+	{
+		FREE(pl->groups[i].shost);
+		FREE(pl->groups[i].dhost);
+	}
+
+	FREE(pl->ents);
+	FREE(pl->groups);
+	FREE(pl);
+}
+
+static int
+_plan_same(char * a, char * b)
+{
+	if (!a || !b)
+		return a == b;
+	return strcasecmp(a, b) == 0;
+}
+
+/* Groups are numbered in the order they first appear. */
+static int
+_plan_group(plan_t * pl, char * shost, char * dhost)
+{
+	int i = 0;
+
+	for (i = 0; i < pl->ngroups; i++)
+	{
+		if (_plan_same(pl->groups[i].shost, shost) &&
+		    _plan_same(pl->groups[i].dhost, dhost))
+			return i;
+	}
+
+	pl->groups = (pg_t *) realloc(pl->groups, 
+	                              sizeof(pg_t) * (pl->ngroups + 1));
+	pl->groups[pl->ngroups].shost = Strdup(shost);
+	pl->groups[pl->ngroups].dhost = Strdup(dhost);
+	return pl->ngroups++;
+}
+
+void
+plan_add(plan_t       * pl,
+         char         * srcurl,
+         char         * dsturl,
+         char         * shost,
+         char         * dhost,
+         char         * spath,
+         char         * dpath,
+         globus_off_t   size)
+{
+	pe_t * pe = NULL;
+
+	if (pl->cnt % 1024 == 0)
+		pl->ents = (pe_t *) realloc(pl->ents, sizeof(pe_t) * (pl->cnt + 1024));
+
+	pe = &pl->ents[pl->cnt];
+	pe->srcurl = Strdup(srcurl);
+	pe->dsturl = Strdup(dsturl);
+	pe->spath  = Strdup(spath);
+	pe->dpath  = Strdup(dpath);
+	pe->size   = size;
+	pe->group  = _plan_group(pl, shost, dhost);
+	pe->order  = pl->cnt++;
+}
+
+/* Size buckets, largest first. Unknown sizes follow every known size. */
+static int
+_plan_bucket(globus_off_t size)
+{
+	if (size < 0)
+		return 0;
+	if (size < 1024 * 1024)
+		return 1;
+	if (size < 64 * 1024 * 1024)
+		return 2;
+	if (size < 1024 * 1024 * 1024)
+		return 3;
+	return 4;
+}
+
+/* Compare the directory portions of two paths. */
+static int
+_plan_dircmp(char * a, char * b)
+{
+	char * sa   = a ? strrchr(a, '/') : NULL;
+	char * sb   = b ? strrchr(b, '/') : NULL;
+	size_t alen = sa ? sa - a : 0;
+	size_t blen = sb ? sb - b : 0;
+	int    rc   = 0;
+
+	rc = strncmp(alen ? a : "", blen ? b : "", alen < blen ? alen : blen);
+	if (rc)
+		return rc;
+	return (alen > blen) - (alen < blen);
+}
+
+static int
+_plan_cmp(const void * a, const void * b)
+{
+	pe_t * pa = (pe_t *) a;
+	pe_t * pb = (pe_t *) b;
+	int    rc = 0;
+
+	if (pa->group != pb->group)
+		return pa->group - pb->group;
+
+	rc = _plan_bucket(pb->size) - _plan_bucket(pa->size);
+	if (rc)
+		return rc;
+
+	rc = _plan_dircmp(pa->spath, pb->spath);
+	if (rc)
+		return rc;
+
+	rc = _plan_dircmp(pa->dpath, pb->dpath);
+	if (rc)
+		return rc;
+
+	return pa->order - pb->order;
+}
+
+void
+plan_sort(plan_t * pl)
+{
+	qsort(pl->ents, pl->cnt, sizeof(pe_t), _plan_cmp);
+	pl->next = 0;
+}
+
+void
+plan_next(plan_t * pl, char ** srcurl, char ** dsturl)
+{
+	*srcurl = *dsturl = NULL;
+
+	if (pl->next == pl->cnt)
+		return;
+
+	*srcurl = pl->ents[pl->next].srcurl;
+	*dsturl = pl->ents[pl->next].dsturl;
+	pl->next++;
+}
+
+void
+plan_print(plan_t * pl)
+{
+	int    i  = 0;
+	pe_t * pe = NULL;
+	pg_t * pg = NULL;
+
+	for (i = 0; i < pl->cnt; i++)
+	{
+		pe = &pl->ents[i];
+		if (i == 0 || pe->group != pl->ents[i-1].group)
+		{
+			pg = &pl->groups[pe->group];
+			o_printf(DEBUG_ERRS_ONLY,
+			         "# %s -> %s\n",
+			         pg->shost ? pg->shost : "local",
+			         pg->dhost ? pg->dhost : "local");
+		}
+
+		o_printf(DEBUG_ERRS_ONLY, "%s %s\n", pe->srcurl, pe->dsturl);
+	}
+}
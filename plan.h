@@ -0,0 +1,85 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef UBER_PLAN_H
+#define UBER_PLAN_H
+
+#include <globus_common.h>
+
+/*
+ * A url file plan. The whole url file is read up front and reordered so
+ * that entries between the same source and destination hosts run back to
+ * back and reuse their sessions. Within a pair of hosts, larger size
+ * buckets run first (when sizes are known) and entries are sorted by
+ * directory so the server's working directory and listings stay warm.
+ * Otherwise, entries keep their file order.
+ */
+
+typedef struct _plan plan_t;
+
+plan_t * plan_init(void);
+void     plan_destroy(plan_t * pl);
+
+/*
+ * Add an entry. shost and dhost are NULL for file: urls. size is the
+ * source size, -1 if it is not known.
+ */
+void plan_add(plan_t       * pl,
+              char         * srcurl,
+              char         * dsturl,
+              char         * shost,
+              char         * dhost,
+              char         * spath,
+              char         * dpath,
+              globus_off_t   size);
+
+/* Order the entries. Call once every entry has been added. */
+void plan_sort(plan_t * pl);
+
+/*
+ * Return the next entry in plan order. *srcurl is set to NULL after the
+ * last entry. The strings belong to the plan.
+ */
+void plan_next(plan_t * pl, char ** srcurl, char ** dsturl);
+
+/* Print the plan in url file format. */
+void plan_print(plan_t * pl);
+
+#endif /* UBER_PLAN_H */
@@ -0,0 +1,294 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "settings.h"
+#include "pool.h"
+
+#ifdef DMALLOC
+#include "dmalloc.h"
+#endif /* DMALLOC */
+
+/* Alignment of the data portion of full sized blocks. */
+#define POOL_ALIGN      4096
+/* Capacity of small blocks (extended block headers). */
+#define POOL_SMALL      64
+/* Most free blocks to hold on to. */
+#define POOL_MAX_BLOCKS 32
+#define POOL_MAX_SMALL  256
+
+/*
+ * The header sits immediately in front of the data portion of each block.
+ */
+typedef struct _pool_hdr {
+	struct _pool_hdr * next;
+	void             * base;
+	size_t             size;
+	size_t             pad;
+} ph_t;
+
+typedef struct {
+	ph_t * head;
+	int    cnt;
+} pl_list_t;
+
+/* Buffers handed to pool_adopt(); they have no header. */
+typedef struct _pool_adopted {
+	struct _pool_adopted * next;
+	char                 * buf;
+	size_t                 size;
+	void                (* release)(char *);
+} pa_t;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pl_list_t       pool_blocks = {NULL, 0};
+static pl_list_t       pool_small  = {NULL, 0};
+static pa_t          * pool_adopted  = NULL;
+static volatile int    pool_nadopted = 0;
+
+#define PH(buf) ((ph_t *)((buf) - sizeof(ph_t)))
+#define PD(ph)  (((char *)(ph)) + sizeof(ph_t))
+
+/*
+ * Finds buf among the adopted buffers, removing it if unlink is set. The
+ * count is checked first so that the common case, no adopted buffers,
+ * does not take the lock.
+ */
+static pa_t *
+_pool_find_adopted(char * buf, int unlink)
+{
+	pa_t  * pa  = NULL;
+	pa_t ** ppa = NULL;
+
+	if (!pool_nadopted)
+		return NULL;
+
+	pthread_mutex_lock(&pool_lock);
+	for (ppa = &pool_adopted; *ppa; ppa = &(*ppa)->next)
+	{
+		if ((*ppa)->buf != buf)
+			continue;
+
+		pa = *ppa;
+		if (unlink)
+		{
+			*ppa = pa->next;
+			pool_nadopted--;
+		}
+		break;
+	}
+	pthread_mutex_unlock(&pool_lock);
+	return pa;
+}
+
+static ph_t *
+_pool_new(size_t size)
+{
+	void * base = NULL;
+	ph_t * ph   = NULL;
+
+	if (size <= POOL_SMALL)
+	{
+		base = malloc(sizeof(ph_t) + POOL_SMALL);
+		if (!base)
+			return NULL;
+		ph = (ph_t *) base;
+		size = POOL_SMALL;
+	} else
+	{
+		if (posix_memalign(&base, POOL_ALIGN, POOL_ALIGN + size))
+			return NULL;
+		ph = (ph_t *)(((char *)base) + POOL_ALIGN - sizeof(ph_t));
+	}
+
+	ph->next = NULL;
+	ph->base = base;
+	ph->size = size;
+	return ph;
+}
+
+static ph_t *
+_pool_get(pl_list_t * list, size_t size)
+{
+	ph_t * ph = NULL;
+
+	pthread_mutex_lock(&pool_lock);
+	ph = list->head;
+	if (ph)
+	{
+		list->head = ph->next;
+		list->cnt--;
+	}
+	pthread_mutex_unlock(&pool_lock);
+
+	/* Blocks left over from a different blksize are not reused. */
+	if (ph && ph->size < size)
+	{
+		free(ph->base);
+		ph = NULL;
+	}
+
+	if (!ph)
+		ph = _pool_new(size);
+	return ph;
+}
+
+char *
+pool_alloc(size_t len)
+{
+	ph_t * ph = NULL;
+
+	if (len <= POOL_SMALL)
+		ph = _pool_get(&pool_small, len);
+	else if (len <= s_blocksize())
+		ph = _pool_get(&pool_blocks, s_blocksize());
+	else
+		ph = _pool_new(len);
+
+	if (!ph)
+		return NULL;
+	return PD(ph);
+}
+
+char *
+pool_adopt(char * buf, size_t len, void (*release)(char *))
+{
+	pa_t * pa = NULL;
+
+	pa = (pa_t *) malloc(sizeof(pa_t));
+	pa->buf     = buf;
+	pa->size    = len;
+	pa->release = release;
+
+	pthread_mutex_lock(&pool_lock);
+	pa->next     = pool_adopted;
+	pool_adopted = pa;
+	pool_nadopted++;
+	pthread_mutex_unlock(&pool_lock);
+
+	return buf;
+}
+
+char *
+pool_realloc(char * buf, size_t len)
+{
+	char * nbuf = NULL;
+	size_t size = 0;
+
+	if (!buf)
+		return pool_alloc(len);
+
+	size = pool_size(buf);
+	if (size >= len)
+		return buf;
+
+	nbuf = pool_alloc(len);
+	if (!nbuf)
+		return NULL;
+
+	memcpy(nbuf, buf, size);
+	pool_free(buf);
+	return nbuf;
+}
+
+size_t
+pool_size(char * buf)
+{
+	pa_t * pa = NULL;
+
+	if (!buf)
+		return 0;
+
+	pa = _pool_find_adopted(buf, 0);
+	if (pa)
+		return pa->size;
+	return PH(buf)->size;
+}
+
+void
+pool_free(char * buf)
+{
+	ph_t      * ph   = NULL;
+	pa_t      * pa   = NULL;
+	pl_list_t * list = NULL;
+	int         max  = 0;
+
+	if (!buf)
+		return;
+
+	pa = _pool_find_adopted(buf, 1);
+	if (pa)
+	{
+		pa->release(buf);
+		free(pa);
+		return;
+	}
+
+	ph = PH(buf);
+
+	if (ph->size == POOL_SMALL)
+	{
+		list = &pool_small;
+		max  = POOL_MAX_SMALL;
+	} else if (ph->size == s_blocksize())
+	{
+		list = &pool_blocks;
+		max  = POOL_MAX_BLOCKS;
+	}
+
+	if (list)
+	{
+		pthread_mutex_lock(&pool_lock);
+		if (list->cnt < max)
+		{
+			ph->next   = list->head;
+			list->head = ph;
+			list->cnt++;
+			ph = NULL;
+		}
+		pthread_mutex_unlock(&pool_lock);
+	}
+
+	if (ph)
+		free(ph->base);
+}
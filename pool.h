@@ -0,0 +1,85 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef UBER_POOL_H
+#define UBER_POOL_H
+
+#include <sys/types.h>
+
+/*
+ * Data block allocator for the transfer path.
+ *
+ * Every buffer that moves through the read() and write() calls of a
+ * Linterface_t, a dci_t or gsi_dc_read()/gsi_dc_write() is a pool block.
+ * read() hands ownership of the block to the caller; write() takes
+ * ownership of the block it is given and releases it with pool_free() once
+ * the data has been written; for zero copy sends, that is when the kernel
+ * reports it has finished with the pages, which may be well after write()
+ * returns. Blocks of s_blocksize() bytes (and the small
+ * blocks used for extended block headers) are recycled instead of being
+ * returned to the heap, so a steady state transfer does not allocate.
+ *
+ * Pool blocks must never be passed to free() or realloc().
+ */
+
+/*
+ * Lets buf, which the pool did not allocate, travel the transfer path as
+ * a pool block of len bytes. pool_free() gives it to release() instead of
+ * recycling it. Returns buf.
+ */
+char *
+pool_adopt(char * buf, size_t len, void (*release)(char *));
+
+/* Returns a block of at least len bytes. */
+char *
+pool_alloc(size_t len);
+
+/* Grows buf to at least len bytes, preserving its contents. */
+char *
+pool_realloc(char * buf, size_t len);
+
+/* Usable length of buf. */
+size_t
+pool_size(char * buf);
+
+void
+pool_free(char * buf);
+
+#endif /* UBER_POOL_H */
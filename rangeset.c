@@ -0,0 +1,358 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <globus_common.h>
+
+#include "rangeset.h"
+#include "errcode.h"
+#include "misc.h"
+
+#ifdef DMALLOC
+#include "dmalloc.h"
+#endif /* DMALLOC */
+
+#define RS_MAGIC "uberftp ranges 1"
+
+typedef struct {
+	globus_off_t off;
+	globus_off_t end;
+} rng_t;
+
+struct _rangeset {
+	rng_t * r;   /* Sorted, neither overlapping nor touching. */
+	int     cnt;
+	int     max;
+};
+
+rs_t *
+rs_init(void)
+{
+	rs_t * rs = (rs_t *) malloc(sizeof(rs_t));
+
+	memset(rs, 0, sizeof(rs_t));
+	return rs;
+}
+
+void
+rs_destroy(rs_t * rs)
+{
+	if (!rs)
+		return;
+
+	FREE(rs->r);
+	FREE(rs);
+}
+
+void
+rs_add(rs_t * rs, globus_off_t off, globus_off_t len)
+{
+	globus_off_t end = off + len;
+	int          lo  = 0;
+	int          hi  = rs->cnt;
+	int          mid = 0;
+	int          j   = 0;
+
+	if (len <= 0)
+		return;
+
+	/* Find the first range that ends at or after off. */
+	while (lo < hi)
+	{
+		mid = (lo + hi) / 2;
+		if (rs->r[mid].end < off)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* Absorb every range that overlaps or touches [off, end). */
+	for (j = lo; j < rs->cnt && rs->r[j].off <= end; j++)
+	{
+		if (rs->r[j].off < off)
+			off = rs->r[j].off;
+		if (rs->r[j].end > end)
+			end = rs->r[j].end;
+	}
+
+	if (j == lo)
+	{
+		if (rs->cnt == rs->max)
+		{
+			rs->max = rs->max ? rs->max * 2 : 16;
+			rs->r = (rng_t *) realloc(rs->r, sizeof(rng_t) * rs->max);
+		}
+		memmove(rs->r + lo + 1, rs->r + lo, sizeof(rng_t) * (rs->cnt - lo));
+		rs->cnt++;
+	} else
+	{
+		memmove(rs->r + lo + 1, rs->r + j, sizeof(rng_t) * (rs->cnt - j));
+		rs->cnt -= j - lo - 1;
+	}
+
+	rs->r[lo].off = off;
+	rs->r[lo].end = end;
+}
+
+void
+rs_merge(rs_t * rs, rs_t * src)
+{
+	int i = 0;
+
+	for (i = 0; i < src->cnt; i++)
+		rs_add(rs, src->r[i].off, src->r[i].end - src->r[i].off);
+}
+
+void
+rs_clear(rs_t * rs)
+{
+	rs->cnt = 0;
+}
+
+globus_off_t
+rs_bytes(rs_t * rs)
+{
+	globus_off_t bytes = 0;
+	int          i     = 0;
+
+	for (i = 0; i < rs->cnt; i++)
+		bytes += rs->r[i].end - rs->r[i].off;
+	return bytes;
+}
+
+globus_off_t
+rs_end(rs_t * rs)
+{
+	if (rs->cnt == 0)
+		return 0;
+	return rs->r[rs->cnt - 1].end;
+}
+
+int
+rs_gap(rs_t          * rs,
+       globus_off_t    from,
+       globus_off_t    to,
+       globus_off_t  * off,
+       globus_off_t  * len)
+{
+	int i = 0;
+
+	for (i = 0; i < rs->cnt && from < to; i++)
+	{
+		if (rs->r[i].end <= from)
+			continue;
+
+		if (rs->r[i].off > from)
+			break;
+
+		from = rs->r[i].end;
+	}
+
+	if (from >= to)
+		return 0;
+
+	*off = from;
+	*len = (i < rs->cnt && rs->r[i].off < to ? rs->r[i].off : to) - from;
+	return 1;
+}
+
+errcode_t
+rs_save(rs_t         * rs,
+        char         * path,
+        char         * src,
+        char         * dst,
+        globus_off_t   size)
+{
+	int       i   = 0;
+	int       rc  = 0;
+	char    * tmp = NULL;
+	FILE    * fp  = NULL;
+	errcode_t ec  = EC_SUCCESS;
+
+	tmp = Sprintf(NULL, "%s.tmp", path);
+	fp  = fopen(tmp, "w");
+	if (!fp)
+	{
+		ec = ec_create(EC_GSI_SUCCESS,
+		               EC_GSI_SUCCESS,
+		               "Failed to open %s: %s",
+		               tmp,
+		               strerror(errno));
+		FREE(tmp);
+		return ec;
+	}
+
+	fprintf(fp, "%s\n", RS_MAGIC);
+	fprintf(fp, "size %" GLOBUS_OFF_T_FORMAT "\n", size);
+	fprintf(fp, "src %s\n", src);
+	fprintf(fp, "dst %s\n", dst);
+	for (i = 0; i < rs->cnt; i++)
+		fprintf(fp,
+		        "%" GLOBUS_OFF_T_FORMAT " %" GLOBUS_OFF_T_FORMAT "\n",
+		        rs->r[i].off,
+		        rs->r[i].end);
+
+	/* Make the new map durable before it replaces the old one. */
+	rc = ferror(fp);
+	if (fflush(fp) || fsync(fileno(fp)))
+		rc = 1;
+	if (fclose(fp) || rc)
+		rc = 1;
+
+	if (!rc)
+		rc = rename(tmp, path);
+
+	if (rc)
+	{
+		ec = ec_create(EC_GSI_SUCCESS,
+		               EC_GSI_SUCCESS,
+		               "Failed to write %s: %s",
+		               path,
+		               strerror(errno));
+		unlink(tmp);
+	}
+
+	FREE(tmp);
+	return ec;
+}
+
+/* Read a line of any length, without the newline. */
+static char *
+_rs_getline(FILE * fp)
+{
+	char * buf = NULL;
+	int    len = 0;
+	int    max = 0;
+
+	while (1)
+	{
+		if (max - len < 2)
+		{
+			max += 1024;
+			buf  = (char *) realloc(buf, max);
+		}
+
+		if (!fgets(buf + len, max - len, fp))
+			break;
+
+		len += strlen(buf + len);
+		if (buf[len - 1] == '\n')
+		{
+			buf[len - 1] = '\0';
+			return buf;
+		}
+	}
+
+	if (len)
+		return buf;
+	FREE(buf);
+	return NULL;
+}
+
+errcode_t
+rs_load(rs_t         * rs,
+        char         * path,
+        char         * src,
+        char         * dst,
+        globus_off_t   size)
+{
+	int            i    = 0;
+	int            ok   = 1;
+	char         * line = NULL;
+	char         * want = NULL;
+	FILE         * fp   = NULL;
+	globus_off_t   off  = 0;
+	globus_off_t   end  = 0;
+
+	fp = fopen(path, "r");
+	if (!fp)
+	{
+		if (errno == ENOENT)
+			return EC_SUCCESS;
+		return ec_create(EC_GSI_SUCCESS,
+		                 EC_GSI_SUCCESS,
+		                 "Failed to open %s: %s",
+		                 path,
+		                 strerror(errno));
+	}
+
+	/* The header must describe this transfer. */
+	for (i = 0; ok && i < 4; i++)
+	{
+		switch (i)
+		{
+		case 0:
+			want = Strdup(RS_MAGIC);
+			break;
+		case 1:
+			want = Sprintf(NULL, "size %" GLOBUS_OFF_T_FORMAT, size);
+			break;
+		case 2:
+			want = Sprintf(NULL, "src %s", src);
+			break;
+		case 3:
+			want = Sprintf(NULL, "dst %s", dst);
+			break;
+		}
+
+		line = _rs_getline(fp);
+		ok   = line && strcmp(line, want) == 0;
+		FREE(line);
+		FREE(want);
+	}
+
+	while (ok && (line = _rs_getline(fp)))
+	{
+		if (sscanf(line,
+		           "%" GLOBUS_OFF_T_FORMAT " %" GLOBUS_OFF_T_FORMAT,
+		           &off,
+		           &end) == 2 && off >= 0 && end > off && end <= size)
+			rs_add(rs, off, end - off);
+		FREE(line);
+	}
+
+	fclose(fp);
+	return EC_SUCCESS;
+}
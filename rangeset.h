@@ -0,0 +1,105 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef UBER_RANGESET_H
+#define UBER_RANGESET_H
+
+#include <globus_common.h>
+
+#include "errcode.h"
+
+/*
+ * A set of byte ranges, used to remember which parts of a file reached the
+ * destination so that a retry only moves what is missing. Ranges are kept
+ * sorted and merged, so the set stays small even when extended block data
+ * arrives out of order.
+ */
+
+typedef struct _rangeset rs_t;
+
+rs_t * rs_init(void);
+void   rs_destroy(rs_t * rs);
+
+/* Add [off, off+len). */
+void rs_add(rs_t * rs, globus_off_t off, globus_off_t len);
+
+/* Add every range in src to rs. */
+void rs_merge(rs_t * rs, rs_t * src);
+
+/* Remove every range. */
+void rs_clear(rs_t * rs);
+
+/* Bytes covered. */
+globus_off_t rs_bytes(rs_t * rs);
+
+/* End of the highest range, 0 if empty. */
+globus_off_t rs_end(rs_t * rs);
+
+/*
+ * Find the first hole in [from, to). Returns 0 if there is none, otherwise
+ * 1 with the hole in *off and *len.
+ */
+int rs_gap(rs_t          * rs,
+           globus_off_t    from,
+           globus_off_t    to,
+           globus_off_t  * off,
+           globus_off_t  * len);
+
+/*
+ * Save rs to path along with the transfer it describes. The file is
+ * replaced atomically.
+ */
+errcode_t rs_save(rs_t         * rs,
+                  char         * path,
+                  char         * src,
+                  char         * dst,
+                  globus_off_t   size);
+
+/*
+ * Load the ranges saved at path into rs. Returns EC_SUCCESS without adding
+ * anything if the file does not exist or describes a different transfer.
+ */
+errcode_t rs_load(rs_t         * rs,
+                  char         * path,
+                  char         * src,
+                  char         * dst,
+                  globus_off_t   size);
+
+#endif /* UBER_RANGESET_H */
@@ -0,0 +1,235 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+#include "settings.h"
+#include "ratelimit.h"
+#include "misc.h"
+
+#ifdef DMALLOC
+#include "dmalloc.h"
+#endif /* DMALLOC */
+
+/*
+ * Callers get nothing until this much (or what they asked for, if less) is
+ * in the bucket so a throttled transfer is not a storm of tiny writes.
+ */
+#define RL_CHUNK (64 * 1024)
+
+/* Default burst, in seconds of rate. */
+#define RL_BURST_DIV 10
+
+typedef struct {
+	pthread_mutex_t lock;
+	double          tokens;
+	struct timeval  last; /* When tokens was last refilled. */
+} rl_t;
+
+static rl_t * rl = NULL;
+
+void
+rl_init()
+{
+	pthread_mutexattr_t attr;
+
+	if (rl)
+		return;
+
+	rl = (rl_t *) mmap(NULL,
+	                   sizeof(rl_t),
+	                   PROT_READ|PROT_WRITE,
+	                   MAP_SHARED|MAP_ANONYMOUS,
+	                   -1,
+	                   0);
+
+	/* A private bucket still limits this process. */
+	if (rl == MAP_FAILED)
+		rl = (rl_t *) malloc(sizeof(rl_t));
+
+	memset(rl, 0, sizeof(rl_t));
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#ifdef HAVE_PTHREAD_MUTEX_CONSISTENT
+	/* A worker may be killed while it holds the lock. */
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+#endif /* HAVE_PTHREAD_MUTEX_CONSISTENT */
+	pthread_mutex_init(&rl->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+/*
+ * Take the lock from a worker that died holding it. The bucket it left is
+ * at worst a little off, which the next refill evens out.
+ */
+static void
+_rl_lock(void)
+{
+#ifdef HAVE_PTHREAD_MUTEX_CONSISTENT
+	if (pthread_mutex_lock(&rl->lock) == EOWNERDEAD)
+		pthread_mutex_consistent(&rl->lock);
+#else /* HAVE_PTHREAD_MUTEX_CONSISTENT */
+	pthread_mutex_lock(&rl->lock);
+#endif /* HAVE_PTHREAD_MUTEX_CONSISTENT */
+}
+
+static double
+_rl_burst(long long rate)
+{
+	long long burst = s_rateburst();
+
+	if (!burst)
+		burst = rate / RL_BURST_DIV;
+	if (burst < RL_CHUNK)
+		burst = RL_CHUNK;
+	return (double) burst;
+}
+
+/* Add what has accrued since the last refill. Called with the lock held. */
+static void
+_rl_refill(long long rate, double burst)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+
+	/* The first caller starts with a full bucket. */
+	if (!rl->last.tv_sec)
+		rl->tokens = burst;
+	else
+		rl->tokens += rate * ((now.tv_sec - rl->last.tv_sec) +
+		                      (now.tv_usec - rl->last.tv_usec) / 1000000.0);
+
+	if (rl->tokens > burst)
+		rl->tokens = burst;
+	rl->last = now;
+}
+
+size_t
+rl_take(size_t want)
+{
+	long long rate  = s_ratelimit();
+	double    burst = 0;
+	double    need  = 0;
+	size_t    got   = 0;
+
+	if (!rate || !want)
+		return want;
+
+	rl_init();
+
+	burst = _rl_burst(rate);
+	need  = want < RL_CHUNK ? want : RL_CHUNK;
+
+	_rl_lock();
+	_rl_refill(rate, burst);
+	if (rl->tokens >= need)
+	{
+		got = want;
+		if (got > rl->tokens)
+			got = (size_t) rl->tokens;
+		rl->tokens -= got;
+	}
+	pthread_mutex_unlock(&rl->lock);
+
+	return got;
+}
+
+int
+rl_wait()
+{
+	long long rate = s_ratelimit();
+	double    need = 0;
+
+	if (!rate)
+		return 0;
+
+	rl_init();
+
+	_rl_lock();
+	_rl_refill(rate, _rl_burst(rate));
+	need = RL_CHUNK - rl->tokens;
+	pthread_mutex_unlock(&rl->lock);
+
+	if (need <= 0)
+		return 0;
+
+	/* Round up so the caller does not wake just short of it. */
+	return (int) (need * 1000 / rate) + 1;
+}
+
+void
+rl_pause()
+{
+	int             ms = 0;
+	struct timespec ts;
+
+	while ((ms = rl_wait()) > 0)
+	{
+		ts.tv_sec  = ms / 1000;
+		ts.tv_nsec = (ms % 1000) * 1000000L;
+		nanosleep(&ts, NULL);
+	}
+}
+
+void
+rl_return(size_t len)
+{
+	long long rate = s_ratelimit();
+
+	if (!rate || !len || !rl)
+		return;
+
+	_rl_lock();
+	rl->tokens += len;
+	if (rl->tokens > _rl_burst(rate))
+		rl->tokens = _rl_burst(rate);
+	pthread_mutex_unlock(&rl->lock);
+}
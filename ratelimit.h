@@ -0,0 +1,74 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef UBER_RATELIMIT_H
+#define UBER_RATELIMIT_H
+
+#include <sys/types.h>
+
+/*
+ * Bandwidth limit for the data channels. When ratelimit is set, every byte
+ * the data channels send or receive is paid for from one token bucket that
+ * refills at s_ratelimit() bytes per second and holds up to the burst
+ * size. The bucket lives in memory shared with forked workers, so the cap
+ * covers the whole client and not each process. Taking never blocks, so
+ * a caller juggling several streams can sleep on its own reactor until
+ * rl_wait() says the bucket has refilled.
+ */
+
+/* Set up the shared bucket. Must be called before any workers fork. */
+void rl_init(void);
+
+/*
+ * Bytes of want that may be moved now, or 0 if the bucket is short.
+ * Returns want if there is no limit.
+ */
+size_t rl_take(size_t want);
+
+/* Milliseconds until rl_take() can succeed, 0 if it can now. */
+int rl_wait(void);
+
+/* Sleep until rl_take() can succeed. For callers with one stream. */
+void rl_pause(void);
+
+/* Give back bytes that rl_take() allowed but were not moved. */
+void rl_return(size_t len);
+
+#endif /* UBER_RATELIMIT_H */
@@ -0,0 +1,175 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#include <string.h>
+#include <stdlib.h>
+
+#include <globus_common.h>
+
+#include "settings.h"
+#include "reorder.h"
+#include "errcode.h"
+#include "misc.h"
+#include "pool.h"
+
+#ifdef DMALLOC
+#include "dmalloc.h"
+#endif /* DMALLOC */
+
+typedef struct _rob_ {
+	struct _rob_ * next;
+	char         * buf;
+	globus_off_t   off;
+	size_t         len;
+} rob_t;
+
+struct _reorder {
+	globus_off_t next; /* Offset the sink expects. */
+	long long    held; /* Bytes queued. */
+	rob_t      * head; /* Sorted by offset. */
+};
+
+ro_t *
+ro_init(globus_off_t off)
+{
+	ro_t * ro = (ro_t *) malloc(sizeof(ro_t));
+
+	memset(ro, 0, sizeof(ro_t));
+	ro->next = off;
+	return ro;
+}
+
+errcode_t
+ro_put(ro_t * ro, char * buf, globus_off_t off, size_t len)
+{
+	rob_t  * rob  = NULL;
+	rob_t ** robp = NULL;
+
+	if (len == 0)
+	{
+		pool_free(buf);
+		return EC_SUCCESS;
+	}
+
+	if (off < ro->next)
+	{
+		pool_free(buf);
+		return ec_create(EC_GSI_SUCCESS,
+		                 EC_GSI_SUCCESS,
+		                 "Received data at offset %" GLOBUS_OFF_T_FORMAT
+		                 " which was already written",
+		                 off);
+	}
+
+	/* The block the sink is waiting on is never refused. */
+	if (off != ro->next && ro->held + (long long)len > s_reorder())
+	{
+		pool_free(buf);
+		return ec_create(EC_GSI_SUCCESS,
+		                 EC_GSI_SUCCESS,
+		                 "Out of order data exceeds the reorder limit of %lld"
+		                 " bytes. Raise it with 'reorder' or use stream mode.",
+		                 s_reorder());
+	}
+
+	/* Blocks mostly arrive close to order, so the walk is short. */
+	for (robp = &ro->head; *robp && (*robp)->off < off; robp = &(*robp)->next);
+
+	rob = (rob_t *) malloc(sizeof(rob_t));
+	rob->buf  = buf;
+	rob->off  = off;
+	rob->len  = len;
+	rob->next = *robp;
+	*robp     = rob;
+
+	ro->held += len;
+	return EC_SUCCESS;
+}
+
+void
+ro_get(ro_t * ro, char ** buf, globus_off_t * off, size_t * len)
+{
+	rob_t * rob = ro->head;
+
+	*buf = NULL;
+	*off = ro->next;
+	*len = 0;
+
+	if (!rob || rob->off != ro->next)
+		return;
+
+	ro->head  = rob->next;
+	ro->held -= rob->len;
+	ro->next += rob->len;
+
+	*buf = rob->buf;
+	*len = rob->len;
+	FREE(rob);
+}
+
+errcode_t
+ro_finish(ro_t * ro)
+{
+	if (!ro->head)
+		return EC_SUCCESS;
+
+	return ec_create(EC_GSI_SUCCESS,
+	                 EC_GSI_SUCCESS,
+	                 "Transfer ended with no data at offset %"
+	                 GLOBUS_OFF_T_FORMAT,
+	                 ro->next);
+}
+
+void
+ro_destroy(ro_t * ro)
+{
+	rob_t * rob = NULL;
+
+	if (!ro)
+		return;
+
+	while ((rob = ro->head))
+	{
+		ro->head = rob->next;
+		pool_free(rob->buf);
+		FREE(rob);
+	}
+	FREE(ro);
+}
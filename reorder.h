@@ -0,0 +1,76 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef UBER_REORDER_H
+#define UBER_REORDER_H
+
+#include <globus_common.h>
+
+#include "errcode.h"
+
+/*
+ * Extended block data arrives in whatever order the streams deliver it.
+ * Sinks that can not seek (pipes, stdout) put blocks through a reorder
+ * buffer, which holds blocks that arrive ahead of a gap and hands them back
+ * in offset order. At most s_reorder() bytes are held; a transfer that
+ * needs more fails rather than growing without bound.
+ */
+
+typedef struct _reorder ro_t;
+
+/* off is the first offset the sink expects. */
+ro_t * ro_init(globus_off_t off);
+
+/* Queue a pool buffer. The reorder buffer owns buf even on error. */
+errcode_t ro_put(ro_t * ro, char * buf, globus_off_t off, size_t len);
+
+/*
+ * Pop the block at the next expected offset. *buf is NULL if it has not
+ * arrived. The caller owns the returned buffer.
+ */
+void ro_get(ro_t * ro, char ** buf, globus_off_t * off, size_t * len);
+
+/* Error if blocks are still held, i.e. the data had a hole. */
+errcode_t ro_finish(ro_t * ro);
+
+/* Release any held blocks. */
+void ro_destroy(ro_t * ro);
+
+#endif /* UBER_REORDER_H */
@@ -54,11 +54,17 @@
 /* These are the defaults. */
 static int binary    = 1;
 static int cksum     = 0;
+static int concurrency = 1; /* Files in flight during recursive transfers. */
 static int dcau      = 1; /* 0 none, 1 self, 2 subject */
 static int debug     = DEBUG_ERRS_ONLY;
+static int autoparallel = 0; /* Max adaptive streams, 0 is off. */
+static long long autotcpbuf = 0; /* Target stream rate for TCP buffers, 0 is off. */
 static int debug_set = 0;
+static int directio  = 0;
 static int hash      = 0;
+static int hostlimit = 0; /* URL file transfers in flight per host, 0 is off. */
 static int globon    = 1;
+static int ioengine  = IOENGINE_SYNC;
 static int keepalive = 0;
 static unsigned short min_port  = 0; /* TCP_PORT_RANGE min */
 static unsigned short max_port  = 0; /* TCP_PORT_RANGE max */
@@ -66,6 +72,7 @@ static unsigned short min_src   = 0; /* TCP_SOURCE_RANGE min */
 static unsigned short max_src   = 0; /* TCP_SOURCE_RANGE max */
 static int order     = ORDER_BY_NONE;
 static int parallel  = 1;
+static int pipeline  = 2; /* Blocks read ahead of the destination. */
 static int prot      = 0; /* 0 clear, 1 safe, 2 confidential, 3 private */
 static int retry     = 0;
 static int runique   = 0;
@@ -75,10 +82,19 @@ static int waiton    = 0;
 static long long pbsz      = 0; /* Default, determined on the fly */
 static long long tcpbuf    = DEFAULT_TCP_BUFFER_SIZE;
 static long long blocksize = DEFAULT_BLKSIZE;
+static long long stripeblock = 0; /* Striped server layout, 0 if unknown */
 static char * dcau_subject = NULL;
+static char * congestion   = NULL; /* TCP congestion control algorithm */
 static char * cos          = NULL;
 static char * family       = NULL;
+static char * journal      = NULL; /* Completed entries for restarting bulk jobs */
+static char * metrics      = NULL; /* JSON lines file for transfer metrics */
+static char * restartdir   = NULL; /* Where range maps for restarts live */
 static char * resume       = NULL;
+static long long reorder   = 64 * 1024 * 1024; /* Out of order bytes held for pipes */
+static long long zerocopy  = 0; /* Smallest block sent zero copy, 0 is off */
+static long long ratelimit = 0; /* Data channel bytes per second, 0 is off */
+static long long rateburst = 0; /* Token bucket size, 0 is automatic */
 
 #ifdef MSSFTP
 static int passive   = 0;
@@ -168,6 +184,22 @@ s_setascii()
 	binary = 0;
 }
 
+void
+s_setautoparallel(int max)
+{
+	autoparallel = max;
+	if (autoparallel < 0)
+		autoparallel = 0;
+}
+
+void
+s_setautotcpbuf(long long rate)
+{
+	autotcpbuf = rate;
+	if (autotcpbuf < 0)
+		autotcpbuf = 0;
+}
+
 void 
 s_setbinary()
 {
@@ -188,6 +220,23 @@ s_setcksum(int on)
 	cksum = on ? 1 : 0;
 }
 
+void
+s_setconcurrency(int cnt)
+{
+	concurrency = cnt;
+	if (concurrency < 1)
+		concurrency = 1;
+}
+
+void
+s_setcongestion(char * alg)
+{
+	FREE(congestion);
+
+	if (strcasecmp(alg, "default") != 0)
+		congestion = Strdup(alg);
+}
+
 void
 s_setcos(char * Cos)
 {
@@ -218,6 +267,12 @@ s_setdebug(int lvl)
 	debug_set = 1;
 }
 
+void
+s_setdirectio(int on)
+{
+	directio = on ? 1 : 0;
+}
+
 void
 s_setglob(int on)
 {
@@ -245,12 +300,40 @@ s_sethash()
 	hash = !hash;
 }
 
+void
+s_sethostlimit(int cnt)
+{
+	hostlimit = cnt;
+	if (hostlimit < 0)
+		hostlimit = 0;
+}
+
+void
+s_setioengine(int engine)
+{
+	ioengine = engine;
+}
+
+void
+s_setjournal(char * path)
+{
+	FREE(journal);
+	journal = Strdup(path);
+}
+
 void
 s_setkeepalive(int seconds)
 {
 	keepalive = seconds;
 }
 
+void
+s_setmetrics(char * path)
+{
+	FREE(metrics);
+	metrics = Strdup(path);
+}
+
 void
 s_setorder(int o)
 {
@@ -273,6 +356,14 @@ s_setpbsz(long long length)
 		pbsz = 0;
 }
 
+void
+s_setpipeline(int depth)
+{
+	pipeline = depth;
+	if (pipeline < 0)
+		pipeline = 0;
+}
+
 void 
 s_setpassive()
 {
@@ -293,6 +384,37 @@ s_setretry(int cnt)
 		retry = 0;
 }
 
+void
+s_setrateburst(long long size)
+{
+	rateburst = size;
+	if (rateburst < 0)
+		rateburst = 0;
+}
+
+void
+s_setratelimit(long long rate)
+{
+	ratelimit = rate;
+	if (ratelimit < 0)
+		ratelimit = 0;
+}
+
+void
+s_setreorder(long long size)
+{
+	reorder = size;
+	if (reorder < 0)
+		reorder = 0;
+}
+
+void
+s_setrestartdir(char * dir)
+{
+	FREE(restartdir);
+	restartdir = Strdup(dir);
+}
+
 void
 s_setresume(char * path)
 {
@@ -312,6 +434,14 @@ s_setstream()
 	stream = 1;
 }
 
+void
+s_setstripeblock(long long size)
+{
+	stripeblock = size;
+	if (stripeblock < 0)
+		stripeblock = 0;
+}
+
 void
 s_setsunique()
 {
@@ -332,12 +462,32 @@ s_setwait()
 	waiton = !waiton;
 }
 
+void
+s_setzerocopy(long long size)
+{
+	zerocopy = size;
+	if (zerocopy < 0)
+		zerocopy = 0;
+}
+
 int
 s_ascii()
 {
 	return !binary;
 }
 
+int
+s_autoparallel()
+{
+	return autoparallel;
+}
+
+long long
+s_autotcpbuf()
+{
+	return autotcpbuf;
+}
+
 long long
 s_blocksize()
 {
@@ -350,6 +500,18 @@ s_cksum()
 	return cksum;
 }
 
+int
+s_concurrency()
+{
+	return concurrency;
+}
+
+char *
+s_congestion()
+{
+	return congestion;
+}
+
 char *
 s_cos()
 {
@@ -380,6 +542,12 @@ s_debug_set()
 	return debug_set;
 }
 
+int
+s_directio()
+{
+	return directio;
+}
+
 int
 s_glob()
 {
@@ -398,6 +566,18 @@ s_hash()
 	return hash;
 }
 
+int
+s_hostlimit()
+{
+	return hostlimit;
+}
+
+int
+s_ioengine()
+{
+	return ioengine;
+}
+
 int
 s_keepalive()
 {
@@ -428,6 +608,18 @@ s_minport(void)
 	return min_port;
 }
 
+char *
+s_journal()
+{
+	return journal;
+}
+
+char *
+s_metrics()
+{
+	return metrics;
+}
+
 int
 s_order()
 {
@@ -452,6 +644,12 @@ s_passive()
 	return passive;
 }
 
+int
+s_pipeline()
+{
+	return pipeline;
+}
+
 int
 s_prot()
 {
@@ -464,6 +662,30 @@ s_retry()
 	return retry;
 }
 
+long long
+s_rateburst()
+{
+	return rateburst;
+}
+
+long long
+s_ratelimit()
+{
+	return ratelimit;
+}
+
+long long
+s_reorder()
+{
+	return reorder;
+}
+
+char *
+s_restartdir()
+{
+	return restartdir;
+}
+
 char *
 s_resume()
 {
@@ -482,6 +704,12 @@ s_stream()
 	return stream;
 }
 
+long long
+s_stripeblock()
+{
+	return stripeblock;
+}
+
 int
 s_sunique()
 {
@@ -499,3 +727,9 @@ s_wait()
 {
 	return waiton;
 }
+
+long long
+s_zerocopy()
+{
+	return zerocopy;
+}
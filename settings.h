@@ -48,62 +48,99 @@ enum {
 	ORDER_BY_NONE,
 };
 
+enum {
+	IOENGINE_SYNC,  /* read()/write() */
+	IOENGINE_URING, /* io_uring */
+};
+
 void s_init(void);
 void s_setactive(void);
 void s_setascii(void);
 void s_setbinary(void);
+void s_setautoparallel(int max);
+void s_setautotcpbuf(long long rate);
 void s_setblocksize(long long size);
 void s_setcksum(int on);
+void s_setconcurrency(int cnt);
+void s_setcongestion(char * alg);
 void s_setcos(char * cos);
 void s_setdebug(int lvl);
 void s_setdcau(int lvl, char * subject);
+void s_setdirectio(int on);
 void s_seteb(void);
 void s_setfamily(char * family);
 void s_setglob(int on);
 void s_sethash(void);
+void s_sethostlimit(int cnt);
+void s_setioengine(int engine);
+void s_setjournal(char * path);
 void s_setkeepalive(int);
+void s_setmetrics(char * path);
 void s_setmlsx(int on);
 void s_setorder(int);
 void s_setparallel(int cnt);
 void s_setpassive(void);
 void s_setpbsz(long long length);
+void s_setpipeline(int depth);
 void s_setprot(int lvl);
+void s_setrateburst(long long size);
+void s_setratelimit(long long rate);
+void s_setreorder(long long size);
+void s_setrestartdir(char * dir);
 void s_setresume(char * path);
 void s_setretry(int cnt);
 void s_setrunique(void);
 void s_setstream(void);
+void s_setstripeblock(long long size);
 void s_setsunique(void);
 void s_settcpbuf(long long);
 void s_setwait(void);
+void s_setzerocopy(long long size);
 
 int    s_ascii(void);
+int    s_autoparallel(void);
+long long s_autotcpbuf(void);
 long long s_blocksize(void);
 int    s_cksum(void);
+int    s_concurrency(void);
+char * s_congestion(void);
 char * s_cos(void);
 int    s_dcau(void);
 char * s_dcau_subject(void);
 int    s_debug(void);
 int    s_debug_set(void);
+int    s_directio(void);
 char * s_family(void);
 int    s_glob(void);
 int    s_hash(void);
+int    s_hostlimit(void);
+int    s_ioengine(void);
 int    s_order(void);
 int    s_keepalive(void);
 unsigned short s_maxsrc(void);
 unsigned short s_maxport(void);
 unsigned short s_minsrc(void);
 unsigned short s_minport(void);
+char    * s_journal(void);
+char    * s_metrics(void);
 int       s_mlsx(void);
 int       s_parallel(void);
 int       s_passive(void);
 long long s_pbsz(void);
+int       s_pipeline(void);
 int       s_prot(void);
+long long s_rateburst(void);
+long long s_ratelimit(void);
+long long s_reorder(void);
+char    * s_restartdir(void);
 char    * s_resume(void);
 int       s_retry(void);
 int       s_runique(void);
 int       s_stream(void);
+long long s_stripeblock(void);
 int       s_sunique(void);
 long long s_tcpbuf(void);
 int       s_wait(void);
+long long s_zerocopy(void);
 
 #endif /* UBER_SETTINGS_H */
@@ -39,10 +39,16 @@
  * DEALINGS WITH THE SOFTWARE.
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE /* O_DIRECT */
+#endif /* __linux__ */
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/uio.h>
 #include <fnmatch.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <dirent.h>
@@ -55,26 +61,56 @@
 
 #include "settings.h"
 #include "errcode.h"
+#include "output.h"
 #include "cksum.h"
+#include "uring.h"
+#include "reorder.h"
 #include "unix.h"
+#include "pool.h"
 #include "misc.h"
 
 #ifdef DMALLOC
 #include "dmalloc.h"
 #endif /* DMALLOC */
 
+/* Most adjacent blocks unix_write() will hold before writing them out. */
+#define UNIX_MAX_IOV 16
+/* Requests kept in flight by the io_uring engine. */
+#define UNIX_URING_DEPTH 8
+/* Offset, length and buffer alignment required for O_DIRECT. */
+#define UNIX_DIO_ALIGN   4096
+#define UNIX_DIO_ALIGNED(x) ((((unsigned long)(x)) % UNIX_DIO_ALIGN) == 0)
+
 typedef struct {
 	int          fd;
 	globus_off_t len;
 	globus_off_t off;
 	pid_t        pid;
 	char       * opwd;
+	int          seekable; /* 0 for pipes and devices without offsets. */
+
+	/* Adjacent blocks waiting to be written at woff. */
+	globus_off_t woff;
+	size_t       wlen;
+	int          wcnt;
+	struct iovec wiov[UNIX_MAX_IOV];
+	char       * wblk[UNIX_MAX_IOV];
+
+	ur_t       * ur; /* Set when using the io_uring engine. */
+	ro_t       * ro; /* Restores block order when the file can not seek. */
+	int          dfd; /* O_DIRECT descriptor for the same file, or -1. */
 } uh_t;
 
 static errcode_t
 _unix_mlsx(char * ppath, char * path, ml_t ** mlp);
 
 static uh_t * _unix_init(uh_t * uh);
+static errcode_t _unix_flush(uh_t * uh);
+static errcode_t _unix_queue(uh_t * uh, char * buf, globus_off_t off, size_t len);
+static void _unix_uring_init(uh_t * uh);
+static void _unix_dio_open(uh_t * uh, char * file, int flags);
+static int _unix_seekable(int fd);
+static ssize_t _unix_pread(uh_t * uh, char * buf, size_t len);
 #ifdef NOT
 static void _unix_destroy(pd_t * pd);
 #endif /* NOT */
@@ -181,6 +217,14 @@ unix_retr(pd_t * pd,
 			               strerror(errno));
 	}
 
+	if (!ec)
+	{
+		_unix_uring_init(uh);
+		if (uh->ur)
+			ur_read_start(uh->ur, uh->off, uh->len);
+		_unix_dio_open(uh, file, O_RDONLY);
+	}
+
 finish:
 	return ec;
 }
@@ -233,6 +277,10 @@ unix_stor(pd_t * pd,
 
 		close(fds[0]);
 		uh->fd = fds[1];
+		uh->seekable = 0;
+		/* Where the reorder buffer starts. */
+		uh->woff = off == (globus_off_t)-1 ? 0 : off;
+		uh->wlen = 0;
 		return EC_SUCCESS;
 	}
 
@@ -253,7 +301,6 @@ unix_stor(pd_t * pd,
 			filename = Sprintf(NULL, "%s.%d", file, ++ext);
 		}
 	} while (uh->fd == -1 && unique && ext < 1000000 && errno == EEXIST);
-	FREE(filename);
 
 	if (uh->fd == -1)
 		ec = ec_create(EC_GSI_SUCCESS,
@@ -262,6 +309,26 @@ unix_stor(pd_t * pd,
 		               file,
 		               strerror(errno));
 
+	/* _unix_flush() drops this if the file refuses an offset. */
+	uh->seekable = 1;
+
+	/* Treat FIFOs and the like as pipes from the first block on. */
+	if (!ec && !_unix_seekable(uh->fd))
+	{
+		uh->seekable = 0;
+		uh->woff = off == (globus_off_t)-1 ? 0 : off;
+		uh->wlen = 0;
+		FREE(filename);
+		return EC_SUCCESS;
+	}
+
+	if (!ec)
+	{
+		_unix_uring_init(uh);
+		_unix_dio_open(uh, filename, O_WRONLY);
+	}
+
+	FREE(filename);
 	return ec;
 }
 
@@ -277,15 +344,21 @@ unix_read(pd_t          *  pd,
 	uh_t      * uh   = (uh_t *) pd->unixpriv;
 	errcode_t   ec   = EC_SUCCESS;
 
+	if (uh->ur)
+		return ur_read(uh->ur, buf, off, len, eof);
+
 	*eof = 0;
 	*off = uh->off;
-	*buf = (char *) malloc(s_blocksize());
+	*buf = pool_alloc(s_blocksize());
 
 	*len = s_blocksize();
 	if (uh->len != -1 && uh->len < s_blocksize())
 		*len = (size_t)uh->len;
 
-	*len = read(uh->fd, *buf, *len);
+	if (uh->dfd != -1)
+		*len = _unix_pread(uh, *buf, *len);
+	else
+		*len = read(uh->fd, *buf, *len);
 
 	if (*len > 0 && uh->len != -1)
 		uh->len -= *len;
@@ -314,44 +387,40 @@ unix_write(pd_t          * pd,
            int             eof)
 
 {
-	uh_t * uh = (uh_t *) pd->unixpriv;
-	ssize_t   cnt = 0;
-	globus_off_t offset = 0;
-	errcode_t ec  = EC_SUCCESS;
+	uh_t    * uh = (uh_t *) pd->unixpriv;
+	errcode_t ec = EC_SUCCESS;
 
-	/*
-	 * Ideally, I'd like to check that offset == off, but that doesn't work
-	 * if you are writing to /dev/null (at least on RHEL 6.2). In that case,
-	 * lseek() always returns 0.
-	 */
-	offset = lseek(uh->fd, off, SEEK_SET);
-	if (offset == (off_t)-1 && errno != ESPIPE)
+	if (uh->seekable)
 	{
-		FREE(buf);
-		if (offset == (globus_off_t)-1)
-			return ec_create(EC_GSI_SUCCESS,
-			                 EC_GSI_SUCCESS,
-			                 "seek() failed: %s",
-			                 strerror(errno));
-		else
-			return ec_create(EC_GSI_SUCCESS,
-			                 EC_GSI_SUCCESS,
-			                 "seek() failed for unknown reason.");
-	}
-
-	while (len > 0 && ec == EC_SUCCESS)
+		ec = _unix_queue(uh, buf, off, len);
+	} else
 	{
-		cnt = write(uh->fd, buf + cnt, len - cnt);
-		if (cnt == -1)
-			ec = ec_create(EC_GSI_SUCCESS,
-			               EC_GSI_SUCCESS,
-			               "write failed: %s",
-			               strerror(errno));
+		/*
+		 * Pipes take bytes in the order they are written, so blocks that
+		 * arrive ahead of a gap wait in the reorder buffer.
+		 */
+		if (!uh->ro)
+			uh->ro = ro_init(uh->woff + uh->wlen);
+
+		ec = ro_put(uh->ro, buf, off, len);
+		while (!ec)
+		{
+			ro_get(uh->ro, &buf, &off, &len);
+			if (!buf)
+				break;
+			ec = _unix_queue(uh, buf, off, len);
+		}
 
-		len -= cnt;
+		if (!ec && eof)
+			ec = ro_finish(uh->ro);
 	}
 
-	FREE(buf);
+	if (eof && !ec)
+		ec = _unix_flush(uh);
+
+	if (eof && !ec && uh->ur)
+		ec = ur_drain(uh->ur);
+
 	return ec;
 }
 
@@ -361,14 +430,33 @@ unix_close(pd_t * pd)
 	uh_t * uh = (uh_t *) pd->unixpriv;
 	int stat_loc = 0;
 	pid_t pid = 0;
+	errcode_t ec = EC_SUCCESS;
 
 	if (!uh)
 		return EC_SUCCESS;
 
+	/* Write out anything still queued by unix_write(). */
+	ec = _unix_flush(uh);
+
+	if (uh->ur)
+	{
+		if (!ec)
+			ec = ur_drain(uh->ur);
+		ur_destroy(uh->ur);
+		uh->ur = NULL;
+	}
+
 	if (uh->fd != -1)
 		close(uh->fd);
 	uh->fd = -1;
 
+	if (uh->dfd != -1)
+		close(uh->dfd);
+	uh->dfd = -1;
+
+	ro_destroy(uh->ro);
+	uh->ro = NULL;
+
 	if (uh->pid > 0)
 		waitpid(pid, &stat_loc, 0);
 	uh->pid = 0;
@@ -376,7 +464,7 @@ unix_close(pd_t * pd)
 	uh->off = 0;
 	uh->len = 0;
 
-	return EC_SUCCESS;
+	return ec;
 }
 
 
@@ -1021,6 +1109,31 @@ unix_lsfam(pd_t * pd, char ** families)
 	                 "lsfam not supported locally");
 }
 
+/*
+ * Hand out the descriptor for zero copy transfers. Only plain files opened
+ * without io_uring or O_DIRECT qualify; everything else goes through
+ * unix_read() and unix_write().
+ */
+static int
+unix_fileno(pd_t * pd)
+{
+	uh_t      * uh   = (uh_t *) pd->unixpriv;
+
+	if (!uh || uh->fd == -1 || uh->ur || uh->dfd != -1)
+		return -1;
+
+	if (!_unix_seekable(uh->fd))
+		return -1;
+
+	return uh->fd;
+}
+
+static char *
+unix_url(pd_t * pd, char * path)
+{
+	return Sprintf(NULL, "file:%s", path);
+}
+
 #ifdef SYSLOG_PERF
 char *
 unix_rhost (pd_t * pd)
@@ -1061,6 +1174,14 @@ const Linterface_t UnixInterface = {
 	unix_utime,
 	unix_lscos,
 	unix_lsfam,
+	NULL, /* detach */
+	unix_fileno,
+	NULL, /* zcopy */
+	NULL, /* sendfile */
+	NULL, /* recvfile */
+	unix_url,
+	NULL, /* lost */
+	NULL, /* interrupt */
 #ifdef SYSLOG_PERF
 	unix_rhost,
 #endif /* SYSLOG_PERF */
@@ -1203,11 +1324,255 @@ _unix_init(uh_t * uh)
 	{
 		uh = (uh_t *) malloc(sizeof(uh_t));
 		memset(uh, 0, sizeof(uh_t));
-		uh->fd = -1;
+		uh->fd  = -1;
+		uh->dfd = -1;
 	}
 	return uh;
 }
 
+static ssize_t
+_unix_pwritev(int fd, struct iovec * iov, int iovcnt, globus_off_t off)
+{
+#ifdef HAVE_PWRITEV
+	return pwritev(fd, iov, iovcnt, off);
+#else /* HAVE_PWRITEV */
+	return pwrite(fd, iov->iov_base, iov->iov_len, off);
+#endif /* HAVE_PWRITEV */
+}
+
+/*
+ * Blocks that continue the pending run are queued so that they go out in a
+ * single vectored write. Anything else starts a new run.
+ */
+static errcode_t
+_unix_queue(uh_t * uh, char * buf, globus_off_t off, size_t len)
+{
+	errcode_t ec = EC_SUCCESS;
+
+	if (len == 0)
+	{
+		pool_free(buf);
+		return ec;
+	}
+
+	if (uh->wcnt && 
+	    (uh->wcnt == UNIX_MAX_IOV || off != uh->woff + uh->wlen))
+	{
+		ec = _unix_flush(uh);
+		if (ec)
+		{
+			pool_free(buf);
+			return ec;
+		}
+	}
+
+	if (!uh->wcnt)
+		uh->woff = off;
+
+	uh->wiov[uh->wcnt].iov_base = buf;
+	uh->wiov[uh->wcnt].iov_len  = len;
+	uh->wblk[uh->wcnt] = buf;
+	uh->wcnt++;
+	uh->wlen += len;
+	return ec;
+}
+
+/*
+ * Write the pending run of blocks starting at uh->woff and release them.
+ * Writes are positional so that out of order extended block data needs no
+ * seek; pipes and devices that refuse an offset are written sequentially.
+ */
+static errcode_t
+_unix_flush(uh_t * uh)
+{
+	errcode_t      ec     = EC_SUCCESS;
+	ssize_t        cnt    = 0;
+	int            i      = 0;
+	int            dio    = 0;
+	int            iovcnt = uh->wcnt;
+	struct iovec * iov    = uh->wiov;
+
+	/* The ring takes the blocks and writes them in the background. */
+	if (uh->ur && uh->wcnt)
+	{
+		ec = ur_writev(uh->ur, uh->woff, uh->wiov, uh->wblk, uh->wcnt);
+		uh->wcnt = 0;
+		uh->wlen = 0;
+		return ec;
+	}
+
+	while (iovcnt > 0)
+	{
+		/*
+		 * Leading blocks that satisfy O_DIRECT's alignment go through the
+		 * direct descriptor. An unaligned block (a file's tail or an odd
+		 * extended block offset) is written through the page cache on its
+		 * own before we try direct again.
+		 */
+		dio = 0;
+		if (uh->dfd != -1 && UNIX_DIO_ALIGNED(uh->woff))
+		{
+			for (dio = 0; dio < iovcnt; dio++)
+			{
+				if (!UNIX_DIO_ALIGNED(iov[dio].iov_base) ||
+				    !UNIX_DIO_ALIGNED(iov[dio].iov_len))
+					break;
+			}
+		}
+
+		if (dio)
+			cnt = _unix_pwritev(uh->dfd, iov, dio, uh->woff);
+		else if (uh->seekable)
+			cnt = _unix_pwritev(uh->fd, 
+			                    iov, 
+			                    uh->dfd != -1 ? 1 : iovcnt, 
+			                    uh->woff);
+		else
+			cnt = writev(uh->fd, iov, iovcnt);
+
+		if (cnt == -1 && errno == EINTR)
+			continue;
+
+		if (cnt == -1 && errno == EINVAL && dio)
+		{
+			/* The filesystem will not do direct I/O after all. */
+			close(uh->dfd);
+			uh->dfd = -1;
+			continue;
+		}
+
+		if (cnt == -1 && errno == ESPIPE && uh->seekable)
+		{
+			uh->seekable = 0;
+			continue;
+		}
+
+		if (cnt <= 0)
+		{
+			ec = ec_create(EC_GSI_SUCCESS,
+			               EC_GSI_SUCCESS,
+			               "write failed: %s",
+			               cnt ? strerror(errno) : "no data written");
+			break;
+		}
+
+		/* Step past whatever was written. */
+		uh->woff += cnt;
+		while (cnt > 0)
+		{
+			if ((size_t)cnt < iov->iov_len)
+			{
+				iov->iov_base  = (char *)iov->iov_base + cnt;
+				iov->iov_len  -= cnt;
+				break;
+			}
+			cnt -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+	}
+
+	for (i = 0; i < uh->wcnt; i++)
+		pool_free(uh->wblk[i]);
+	uh->wcnt = 0;
+	uh->wlen = 0;
+
+	return ec;
+}
+
+/*
+ * Attach an io_uring to uh->fd if the ioengine setting asks for one.
+ * Without kernel support we quietly stay with read() and write().
+ */
+static void
+_unix_uring_init(uh_t * uh)
+{
+	errcode_t ec = EC_SUCCESS;
+
+	if (s_ioengine() != IOENGINE_URING)
+		return;
+
+	ec = ur_init(&uh->ur, uh->fd, UNIX_URING_DEPTH);
+	if (ec)
+		o_printf(DEBUG_VERBOSE, "io_uring unavailable, using read()/write()\n");
+	ec_destroy(ec);
+}
+
+/*
+ * Open a second descriptor on file with O_DIRECT if the directio setting is
+ * on. Reads and writes that meet the alignment rules use it; everything
+ * else goes through uh->fd. The io_uring engine always uses uh->fd.
+ */
+/*
+ * FIFOs, sockets and terminals take bytes in the order they are written.
+ * Files and devices, /dev/null included, take offsets.
+ */
+static int
+_unix_seekable(int fd)
+{
+	struct stat st;
+
+	if (fstat(fd, &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode)))
+		return 0;
+
+	if (isatty(fd))
+		return 0;
+
+	return lseek(fd, 0, SEEK_CUR) != -1 || errno != ESPIPE;
+}
+
+static void
+_unix_dio_open(uh_t * uh, char * file, int flags)
+{
+#ifdef O_DIRECT
+	if (!s_directio() || uh->ur)
+		return;
+
+	if (!UNIX_DIO_ALIGNED(s_blocksize()))
+	{
+		o_printf(DEBUG_VERBOSE, 
+		         "blksize is not a multiple of %d, not using O_DIRECT\n",
+		         UNIX_DIO_ALIGN);
+		return;
+	}
+
+	if (!_unix_seekable(uh->fd))
+		return;
+
+	uh->dfd = open(file, flags|O_DIRECT);
+	if (uh->dfd == -1)
+		o_printf(DEBUG_VERBOSE, 
+		         "Not using O_DIRECT for %s: %s\n", 
+		         file, 
+		         strerror(errno));
+#endif /* O_DIRECT */
+}
+
+/*
+ * Positional read at uh->off that uses the O_DIRECT descriptor when the
+ * request is aligned.
+ */
+static ssize_t
+_unix_pread(uh_t * uh, char * buf, size_t len)
+{
+	ssize_t cnt = 0;
+
+	if (UNIX_DIO_ALIGNED(uh->off) && 
+	    UNIX_DIO_ALIGNED(len)     && 
+	    UNIX_DIO_ALIGNED(buf))
+	{
+		cnt = pread(uh->dfd, buf, len, uh->off);
+		if (cnt != -1 || errno != EINVAL)
+			return cnt;
+
+		/* The filesystem will not do direct I/O after all. */
+		close(uh->dfd);
+		uh->dfd = -1;
+	}
+
+	return pread(uh->fd, buf, len, uh->off);
+}
+
 #ifdef NOT
 static void
 _unix_destroy(pd_t * pd)
@@ -0,0 +1,528 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif /* HAVE_LIBURING */
+
+#include "settings.h"
+#include "errcode.h"
+#include "uring.h"
+#include "pool.h"
+#include "misc.h"
+
+#ifdef DMALLOC
+#include "dmalloc.h"
+#endif /* DMALLOC */
+
+#ifdef HAVE_LIBURING
+
+typedef struct {
+	int            busy;  /* Submitted, not yet completed. */
+	int            done;  /* Read completed, not yet handed back. */
+	int            res;
+	globus_off_t   off;
+	size_t         len;   /* Bytes requested by a read. */
+	char         * buf;   /* Read block. */
+
+	/* Writes. iov[first] .. iov[iovcnt-1] have not been written yet. */
+	struct iovec * iov;
+	int            first;
+	int            iovcnt;
+	char        ** blks;
+	int            nblks;
+} urs_t;
+
+struct _uring {
+	struct io_uring ring;
+	int             fd;
+	int             depth;
+	int             inflight;
+	urs_t         * slots;
+
+	/* Read ahead. slots[head] holds the lowest outstanding offset. */
+	int             head;
+	int             queued;
+	globus_off_t    next;
+	globus_off_t    end;  /* -1 reads to end of file. */
+	int             eof;
+
+	/* First write failure, reported by the next call. */
+	errcode_t       ec;
+};
+
+static void
+_ur_write_release(urs_t * s)
+{
+	int i = 0;
+
+	for (i = 0; i < s->nblks; i++)
+		pool_free(s->blks[i]);
+
+	FREE(s->iov);
+	FREE(s->blks);
+	s->nblks  = 0;
+	s->iovcnt = 0;
+	s->first  = 0;
+}
+
+static void
+_ur_write_submit(ur_t * ur, urs_t * s)
+{
+	struct io_uring_sqe * sqe = io_uring_get_sqe(&ur->ring);
+
+	/* A slot just came free, so there is always room. */
+	io_uring_prep_writev(sqe, 
+	                     ur->fd, 
+	                     s->iov + s->first, 
+	                     s->iovcnt - s->first, 
+	                     s->off);
+	io_uring_sqe_set_data(sqe, s);
+	io_uring_submit(&ur->ring);
+
+	s->busy = 1;
+	ur->inflight++;
+}
+
+static void
+_ur_write_done(ur_t * ur, urs_t * s)
+{
+	size_t cnt = 0;
+
+	if (s->res == -EINTR || s->res == -EAGAIN)
+	{
+		_ur_write_submit(ur, s);
+		return;
+	}
+
+	if (s->res <= 0)
+	{
+		if (!ur->ec)
+			ur->ec = ec_create(EC_GSI_SUCCESS,
+			                   EC_GSI_SUCCESS,
+			                   "write failed: %s",
+			                   s->res ? strerror(-s->res) : "no data written");
+		_ur_write_release(s);
+		return;
+	}
+
+	/* Step past whatever was written; resubmit the rest. */
+	cnt     = s->res;
+	s->off += cnt;
+	while (cnt > 0 && s->first < s->iovcnt)
+	{
+		if (cnt < s->iov[s->first].iov_len)
+		{
+			s->iov[s->first].iov_base = (char *)s->iov[s->first].iov_base + cnt;
+			s->iov[s->first].iov_len -= cnt;
+			break;
+		}
+		cnt -= s->iov[s->first].iov_len;
+		s->first++;
+	}
+
+	if (s->first < s->iovcnt)
+	{
+		_ur_write_submit(ur, s);
+		return;
+	}
+
+	_ur_write_release(s);
+}
+
+/* Reap one completion. */
+static void
+_ur_wait(ur_t * ur)
+{
+	int                   i   = 0;
+	int                   rc  = 0;
+	urs_t               * s   = NULL;
+	struct io_uring_cqe * cqe = NULL;
+
+	do {
+		rc = io_uring_wait_cqe(&ur->ring, &cqe);
+	} while (rc == -EINTR);
+
+	if (rc < 0)
+	{
+		/* The ring is unusable; fail everything in flight. */
+		for (i = 0; i < ur->depth; i++)
+		{
+			s = &ur->slots[i];
+			if (!s->busy)
+				continue;
+			s->busy = 0;
+			s->done = 1;
+			s->res  = rc;
+			if (s->iov)
+				_ur_write_done(ur, s);
+		}
+		ur->inflight = 0;
+		return;
+	}
+
+	s = (urs_t *) io_uring_cqe_get_data(cqe);
+	s->res = cqe->res;
+	io_uring_cqe_seen(&ur->ring, cqe);
+
+	s->busy = 0;
+	s->done = 1;
+	ur->inflight--;
+
+	if (s->iov)
+		_ur_write_done(ur, s);
+}
+
+/* Keep the ring full of reads. */
+static void
+_ur_fill(ur_t * ur)
+{
+	urs_t               * s   = NULL;
+	struct io_uring_sqe * sqe = NULL;
+	size_t                len = 0;
+
+	while (ur->queued < ur->depth && !ur->eof)
+	{
+		if (ur->end != -1 && ur->next >= ur->end)
+			break;
+
+		len = s_blocksize();
+		if (ur->end != -1 && ur->end - ur->next < len)
+			len = (size_t)(ur->end - ur->next);
+
+		sqe = io_uring_get_sqe(&ur->ring);
+		if (!sqe)
+			break;
+
+		s = &ur->slots[(ur->head + ur->queued) % ur->depth];
+		s->buf  = pool_alloc(s_blocksize());
+		s->off  = ur->next;
+		s->len  = len;
+		s->busy = 1;
+		s->done = 0;
+
+		io_uring_prep_read(sqe, ur->fd, s->buf, len, s->off);
+		io_uring_sqe_set_data(sqe, s);
+
+		ur->inflight++;
+		ur->queued++;
+		ur->next += len;
+	}
+
+	io_uring_submit(&ur->ring);
+}
+
+/* Throw away all outstanding reads. */
+static void
+_ur_discard(ur_t * ur)
+{
+	urs_t * s = NULL;
+
+	while (ur->queued)
+	{
+		s = &ur->slots[ur->head];
+		while (s->busy)
+			_ur_wait(ur);
+
+		pool_free(s->buf);
+		s->buf  = NULL;
+		s->done = 0;
+
+		ur->head = (ur->head + 1) % ur->depth;
+		ur->queued--;
+	}
+}
+
+int
+ur_supported()
+{
+	return 1;
+}
+
+errcode_t
+ur_init(ur_t ** urp, int fd, int depth)
+{
+	int    rc = 0;
+	ur_t * ur = NULL;
+
+	*urp = NULL;
+
+	ur = (ur_t *) malloc(sizeof(ur_t));
+	memset(ur, 0, sizeof(ur_t));
+
+	rc = io_uring_queue_init(depth, &ur->ring, 0);
+	if (rc < 0)
+	{
+		FREE(ur);
+		return ec_create(EC_GSI_SUCCESS,
+		                 EC_GSI_SUCCESS,
+		                 "io_uring setup failed: %s",
+		                 strerror(-rc));
+	}
+
+	ur->fd    = fd;
+	ur->depth = depth;
+	ur->end   = -1;
+	ur->slots = (urs_t *) malloc(sizeof(urs_t) * depth);
+	memset(ur->slots, 0, sizeof(urs_t) * depth);
+
+	*urp = ur;
+	return EC_SUCCESS;
+}
+
+void
+ur_read_start(ur_t * ur, globus_off_t off, globus_off_t len)
+{
+	ur->next = off;
+	ur->end  = len == (globus_off_t)-1 ? -1 : off + len;
+	ur->eof  = 0;
+	_ur_fill(ur);
+}
+
+errcode_t
+ur_read(ur_t          *  ur,
+        char          ** buf,
+        globus_off_t  *  off,
+        size_t        *  len,
+        int           *  eof)
+{
+	urs_t * s   = NULL;
+	char  * blk = NULL;
+	int     res = 0;
+
+	*eof = 0;
+	*len = 0;
+	*off = ur->next;
+
+	if (!ur->queued)
+	{
+		*buf = pool_alloc(s_blocksize());
+		*eof = 1;
+		return EC_SUCCESS;
+	}
+
+	s = &ur->slots[ur->head];
+	while (!s->done)
+		_ur_wait(ur);
+
+	blk  = s->buf;
+	res  = s->res;
+	*off = s->off;
+
+	s->buf  = NULL;
+	s->done = 0;
+	ur->head = (ur->head + 1) % ur->depth;
+	ur->queued--;
+
+	if (res < 0)
+	{
+		pool_free(blk);
+		*buf = NULL;
+		return ec_create(EC_GSI_SUCCESS,
+		                 EC_GSI_SUCCESS,
+		                 "read error: %s",
+		                 strerror(-res));
+	}
+
+	*buf = blk;
+	*len = res;
+
+	if (res == 0)
+	{
+		ur->eof = 1;
+		*eof = 1;
+		_ur_discard(ur);
+		return EC_SUCCESS;
+	}
+
+	/*
+	 * A short read leaves a hole in front of the reads queued behind it.
+	 * Drop them and continue from where this one stopped.
+	 */
+	if (res < s->len)
+	{
+		_ur_discard(ur);
+		ur->next = *off + res;
+	}
+
+	if (ur->end != -1 && *off + res >= ur->end)
+		*eof = 1;
+
+	_ur_fill(ur);
+	return EC_SUCCESS;
+}
+
+errcode_t
+ur_writev(ur_t         * ur,
+          globus_off_t   off,
+          struct iovec * iov,
+          char        ** blks,
+          int            cnt)
+{
+	int       i  = 0;
+	urs_t   * s  = NULL;
+	errcode_t ec = EC_SUCCESS;
+
+	while (ur->inflight == ur->depth)
+		_ur_wait(ur);
+
+	if (ur->ec)
+	{
+		for (i = 0; i < cnt; i++)
+			pool_free(blks[i]);
+		ec = ur->ec;
+		ur->ec = EC_SUCCESS;
+		return ec;
+	}
+
+	for (i = 0; i < ur->depth && ur->slots[i].busy; i++);
+	s = &ur->slots[i];
+
+	s->iov = (struct iovec *) malloc(sizeof(struct iovec) * cnt);
+	memcpy(s->iov, iov, sizeof(struct iovec) * cnt);
+	s->blks = (char **) malloc(sizeof(char *) * cnt);
+	memcpy(s->blks, blks, sizeof(char *) * cnt);
+	s->nblks  = cnt;
+	s->iovcnt = cnt;
+	s->first  = 0;
+	s->off    = off;
+
+	_ur_write_submit(ur, s);
+	return EC_SUCCESS;
+}
+
+errcode_t
+ur_drain(ur_t * ur)
+{
+	errcode_t ec = EC_SUCCESS;
+
+	while (ur->inflight)
+		_ur_wait(ur);
+
+	ec = ur->ec;
+	ur->ec = EC_SUCCESS;
+	return ec;
+}
+
+void
+ur_destroy(ur_t * ur)
+{
+	int i = 0;
+
+	if (!ur)
+		return;
+
+	while (ur->inflight)
+		_ur_wait(ur);
+
+	for (i = 0; i < ur->depth; i++)
+	{
+		pool_free(ur->slots[i].buf);
+		_ur_write_release(&ur->slots[i]);
+	}
+
+	ec_destroy(ur->ec);
+	io_uring_queue_exit(&ur->ring);
+	FREE(ur->slots);
+	FREE(ur);
+}
+
+#else /* HAVE_LIBURING */
+
+int
+ur_supported()
+{
+	return 0;
+}
+
+errcode_t
+ur_init(ur_t ** urp, int fd, int depth)
+{
+	*urp = NULL;
+	return ec_create(EC_GSI_SUCCESS,
+	                 EC_GSI_SUCCESS,
+	                 "io_uring support was not compiled in");
+}
+
+void
+ur_read_start(ur_t * ur, globus_off_t off, globus_off_t len)
+{
+}
+
+errcode_t
+ur_read(ur_t          *  ur,
+        char          ** buf,
+        globus_off_t  *  off,
+        size_t        *  len,
+        int           *  eof)
+{
+	return EC_SUCCESS;
+}
+
+errcode_t
+ur_writev(ur_t         * ur,
+          globus_off_t   off,
+          struct iovec * iov,
+          char        ** blks,
+          int            cnt)
+{
+	return EC_SUCCESS;
+}
+
+errcode_t
+ur_drain(ur_t * ur)
+{
+	return EC_SUCCESS;
+}
+
+void
+ur_destroy(ur_t * ur)
+{
+}
+
+#endif /* HAVE_LIBURING */
@@ -0,0 +1,114 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef UBER_URING_H
+#define UBER_URING_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <globus_common.h>
+
+#include "errcode.h"
+
+/*
+ * io_uring engine for local files. A ring is bound to a single open file
+ * and is used either to read it ahead or to write it behind; never both.
+ * All buffers are pool blocks.
+ */
+
+typedef struct _uring ur_t;
+
+/*
+ * Returns 1 if this build can use io_uring.
+ */
+int
+ur_supported(void);
+
+/*
+ * Set up a ring with up to depth requests in flight against fd. Fails if
+ * the kernel does not provide io_uring; callers fall back to plain
+ * read()/write() in that case.
+ */
+errcode_t
+ur_init(ur_t ** urp, int fd, int depth);
+
+/*
+ * Start reading len bytes (-1 for the whole file) at off, s_blocksize()
+ * bytes per request.
+ */
+void
+ur_read_start(ur_t * ur, globus_off_t off, globus_off_t len);
+
+/*
+ * Same semantics as the unix service's read(). Blocks are returned in
+ * offset order.
+ */
+errcode_t
+ur_read(ur_t          *  ur,
+        char          ** buf,
+        globus_off_t  *  off,
+        size_t        *  len,
+        int           *  eof);
+
+/*
+ * Queue a write of the cnt buffers in iov at off. The ring takes ownership
+ * of the cnt blocks in blks. Errors from earlier writes are returned here
+ * or from ur_drain().
+ */
+errcode_t
+ur_writev(ur_t         * ur,
+          globus_off_t   off,
+          struct iovec * iov,
+          char        ** blks,
+          int            cnt);
+
+/*
+ * Wait for all queued writes to complete.
+ */
+errcode_t
+ur_drain(ur_t * ur);
+
+/*
+ * Wait for anything in flight and release the ring.
+ */
+void
+ur_destroy(ur_t * ur);
+
+#endif /* UBER_URING_H */
@@ -0,0 +1,378 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <stdio.h>
+#include <poll.h>
+
+#include "errcode.h"
+#include "journal.h"
+#include "worker.h"
+#include "misc.h"
+
+#ifdef DMALLOC
+#include "dmalloc.h"
+#endif /* DMALLOC */
+
+typedef struct {
+	pid_t pid;  /* 0 once the worker is gone. */
+	int   fd;   /* Parent's end of the socketpair. */
+	int   busy;
+	int   id;   /* Job in progress. */
+} wk_t;
+
+struct _worker_pool {
+	wk_t  * workers;
+	int     count;
+	wpi_t   wpi;
+	void  * arg;
+};
+
+static int
+_wp_read(int fd, void * buf, size_t len)
+{
+	ssize_t cnt = 0;
+
+	while (len > 0)
+	{
+		cnt = read(fd, buf, len);
+		if (cnt == -1 && errno == EINTR)
+			continue;
+		if (cnt <= 0)
+			return -1;
+		buf  = (char *)buf + cnt;
+		len -= cnt;
+	}
+	return 0;
+}
+
+static int
+_wp_write(int fd, void * buf, size_t len)
+{
+	ssize_t cnt = 0;
+
+	while (len > 0)
+	{
+		cnt = write(fd, buf, len);
+		if (cnt == -1 && errno == EINTR)
+			continue;
+		if (cnt <= 0)
+			return -1;
+		buf  = (char *)buf + cnt;
+		len -= cnt;
+	}
+	return 0;
+}
+
+static void
+_wp_child(wp_t * wp, int fd)
+{
+	int    id     = 0;
+	int    result = 0;
+	size_t len    = 0;
+	char * job    = NULL;
+
+	if (wp->wpi.start)
+		wp->wpi.start(wp->arg);
+
+	while (_wp_read(fd, &id, sizeof(id)) == 0 &&
+	       _wp_read(fd, &len, sizeof(len)) == 0)
+	{
+		job = (char *) malloc(len + 1);
+		if (_wp_read(fd, job, len))
+			break;
+		job[len] = '\0';
+
+		result = wp->wpi.run(wp->arg, job, len);
+		FREE(job);
+
+		fflush(stdout);
+		fflush(stderr);
+
+		if (_wp_write(fd, &id, sizeof(id)) ||
+		    _wp_write(fd, &result, sizeof(result)))
+			break;
+	}
+
+	FREE(job);
+
+	if (wp->wpi.stop)
+		wp->wpi.stop(wp->arg);
+
+	/* _exit() skips atexit(), so flush the journal here. */
+	jn_sync();
+
+	fflush(stdout);
+	fflush(stderr);
+	_exit(0);
+}
+
+static void
+_wp_reap(wp_t * wp, wk_t * wk)
+{
+	int status = 0;
+
+	if (!wk->pid)
+		return;
+
+	close(wk->fd);
+	while (waitpid(wk->pid, &status, 0) == -1 && errno == EINTR);
+
+	wk->pid  = 0;
+	wk->fd   = -1;
+	wk->busy = 0;
+}
+
+/*
+ * Wait for at least one busy worker to finish its job. Returns -1 if no
+ * worker is busy.
+ */
+static int
+_wp_collect(wp_t * wp)
+{
+	int             i      = 0;
+	int             cnt    = 0;
+	int             id     = 0;
+	int             result = 0;
+	struct pollfd * pfds   = NULL;
+
+	pfds = (struct pollfd *) malloc(sizeof(struct pollfd) * wp->count);
+	for (i = 0; i < wp->count; i++)
+	{
+		pfds[i].fd      = wp->workers[i].busy ? wp->workers[i].fd : -1;
+		pfds[i].events  = POLLIN;
+		pfds[i].revents = 0;
+		if (wp->workers[i].busy)
+			cnt++;
+	}
+
+	if (!cnt)
+	{
+		FREE(pfds);
+		return -1;
+	}
+
+	while (poll(pfds, wp->count, -1) == -1 && errno == EINTR);
+
+	for (i = 0; i < wp->count; i++)
+	{
+		if (!pfds[i].revents)
+			continue;
+
+		if (_wp_read(wp->workers[i].fd, &id, sizeof(id)) ||
+		    _wp_read(wp->workers[i].fd, &result, sizeof(result)))
+		{
+			id     = wp->workers[i].id;
+			result = WP_LOST;
+			_wp_reap(wp, &wp->workers[i]);
+		}
+
+		wp->workers[i].busy = 0;
+		wp->wpi.done(wp->arg, id, result);
+	}
+
+	FREE(pfds);
+	return 0;
+}
+
+errcode_t
+wp_init(wp_t ** wpp, int count, wpi_t * wpi, void * arg)
+{
+	int    i   = 0;
+	int    j   = 0;
+	int    sv[2];
+	pid_t  pid = 0;
+	wp_t * wp  = NULL;
+
+	*wpp = NULL;
+
+	wp = (wp_t *) malloc(sizeof(wp_t));
+	memset(wp, 0, sizeof(wp_t));
+	wp->workers = (wk_t *) malloc(sizeof(wk_t) * count);
+	memset(wp->workers, 0, sizeof(wk_t) * count);
+	wp->wpi = *wpi;
+	wp->arg = arg;
+
+	/* Do not let the children replay anything we have buffered. */
+	fflush(stdout);
+	fflush(stderr);
+
+	for (i = 0; i < count; i++)
+	{
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv))
+			break;
+
+		pid = fork();
+		if (pid == -1)
+		{
+			close(sv[0]);
+			close(sv[1]);
+			break;
+		}
+
+		if (pid == 0)
+		{
+			/* Only keep our end of our own socketpair. */
+			for (j = 0; j < wp->count; j++)
+				close(wp->workers[j].fd);
+			close(sv[0]);
+			_wp_child(wp, sv[1]);
+		}
+
+		close(sv[1]);
+		wp->workers[i].pid = pid;
+		wp->workers[i].fd  = sv[0];
+		wp->count++;
+	}
+
+	if (!wp->count)
+	{
+		FREE(wp->workers);
+		FREE(wp);
+		return ec_create(EC_GSI_SUCCESS,
+		                 EC_GSI_SUCCESS,
+		                 "Failed to start worker processes: %s",
+		                 strerror(errno));
+	}
+
+	*wpp = wp;
+	return EC_SUCCESS;
+}
+
+/* Send job to the idle worker wk. Returns non zero if wk is gone. */
+static int
+_wp_send(wp_t * wp, wk_t * wk, int id, char * job, size_t len)
+{
+	if (_wp_write(wk->fd, &id, sizeof(id))   ||
+	    _wp_write(wk->fd, &len, sizeof(len)) ||
+	    _wp_write(wk->fd, job, len))
+	{
+		_wp_reap(wp, wk);
+		return -1;
+	}
+
+	wk->busy = 1;
+	wk->id   = id;
+	return 0;
+}
+
+errcode_t
+wp_submit(wp_t * wp, int id, char * job, size_t len)
+{
+	int    i  = 0;
+	wk_t * wk = NULL;
+
+	while (1)
+	{
+		for (i = 0; i < wp->count; i++)
+		{
+			wk = &wp->workers[i];
+			if (!wk->pid || wk->busy)
+				continue;
+
+			/* If the worker is gone, try the next one. */
+			if (_wp_send(wp, wk, id, job, len) == 0)
+				return EC_SUCCESS;
+		}
+
+		/* Everyone is busy (or dead); wait for a job to finish. */
+		if (_wp_collect(wp))
+			return ec_create(EC_GSI_SUCCESS,
+			                 EC_GSI_SUCCESS,
+			                 "No worker processes remain");
+	}
+}
+
+int
+wp_count(wp_t * wp)
+{
+	return wp->count;
+}
+
+int
+wp_state(wp_t * wp, int worker)
+{
+	if (!wp->workers[worker].pid)
+		return -1;
+	return wp->workers[worker].busy ? 1 : 0;
+}
+
+errcode_t
+wp_submit_to(wp_t * wp, int worker, int id, char * job, size_t len)
+{
+	wk_t * wk = &wp->workers[worker];
+
+	if (!wk->pid || wk->busy || _wp_send(wp, wk, id, job, len))
+		return ec_create(EC_GSI_SUCCESS,
+		                 EC_GSI_SUCCESS,
+		                 "Worker process %d is not available",
+		                 worker);
+	return EC_SUCCESS;
+}
+
+int
+wp_wait(wp_t * wp)
+{
+	return _wp_collect(wp) ? 1 : 0;
+}
+
+void
+wp_destroy(wp_t * wp)
+{
+	int i = 0;
+
+	if (!wp)
+		return;
+
+	while (_wp_collect(wp) == 0);
+
+	/* Closing our end tells each worker to exit. */
+	for (i = 0; i < wp->count; i++)
+		_wp_reap(wp, &wp->workers[i]);
+
+	FREE(wp->workers);
+	FREE(wp);
+}
@@ -0,0 +1,114 @@
+/*
+ * University of Illinois/NCSA Open Source License
+ *
+ * Copyright  2003-2012 NCSA.  All rights reserved.
+ *
+ * Developed by:
+ *
+ * Storage Enabling Technologies (SET)
+ *
+ * Nation Center for Supercomputing Applications (NCSA)
+ *
+ * http://dims.ncsa.uiuc.edu/set/uberftp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the .Software.),
+ * to deal with the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ *    + Redistributions of source code must retain the above copyright notice,
+ *      this list of conditions and the following disclaimers.
+ *
+ *    + Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimers in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *    + Neither the names of SET, NCSA
+ *      nor the names of its contributors may be used to endorse or promote
+ *      products derived from this Software without specific prior written
+ *      permission.
+ *
+ * THE SOFTWARE IS PROVIDED .AS IS., WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS WITH THE SOFTWARE.
+ */
+#ifndef UBER_WORKER_H
+#define UBER_WORKER_H
+
+#include <sys/types.h>
+
+#include "errcode.h"
+
+/*
+ * Pool of forked worker processes. Each worker inherits a copy of the
+ * parent's state (settings, connection handles) at fork time and then runs
+ * jobs handed to it by the parent over a socketpair. Jobs are opaque byte
+ * strings; each job produces a single int result. Since every worker is a
+ * separate process, the services it touches do not need to be thread aware.
+ */
+
+typedef struct _worker_pool wp_t;
+
+/* Result reported for a job whose worker died before answering. */
+#define WP_LOST -1
+
+typedef struct {
+	/* Called in the child once, right after the fork. */
+	void (*start)(void * arg);
+	/* Called in the child for each job. */
+	int  (*run)(void * arg, char * job, size_t len);
+	/* Called in the child before it exits. */
+	void (*stop)(void * arg);
+	/* Called in the parent as each job completes. */
+	void (*done)(void * arg, int id, int result);
+} wpi_t;
+
+/*
+ * Fork count workers. arg is passed to every callback.
+ */
+errcode_t
+wp_init(wp_t ** wpp, int count, wpi_t * wpi, void * arg);
+
+/*
+ * Hand job to the next idle worker, waiting for one to finish if they are
+ * all busy. id is returned to wpi->done() along with the result. Returns an
+ * error if no workers remain; the caller still owns the job in that case.
+ */
+errcode_t
+wp_submit(wp_t * wp, int id, char * job, size_t len);
+
+/* Number of workers started; they are numbered from 0. */
+int
+wp_count(wp_t * wp);
+
+/* 1 if worker is running a job, 0 if it is idle and -1 if it is gone. */
+int
+wp_state(wp_t * wp, int worker);
+
+/*
+ * Hand job to worker, which must be idle. Returns an error if the worker
+ * is gone; the caller still owns the job in that case.
+ */
+errcode_t
+wp_submit_to(wp_t * wp, int worker, int id, char * job, size_t len);
+
+/*
+ * Wait for at least one outstanding job to finish. Returns non zero if no
+ * job was outstanding.
+ */
+int
+wp_wait(wp_t * wp);
+
+/*
+ * Wait for all outstanding jobs, then stop and reap the workers.
+ */
+void
+wp_destroy(wp_t * wp);
+
+#endif /* UBER_WORKER_H */